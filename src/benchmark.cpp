@@ -0,0 +1,626 @@
+#include "benchmark.hpp"
+#include "bundle.hpp"
+#include "calibration.hpp"
+#include "framepool.hpp"
+#include "presence.hpp"
+#include "reprojection.hpp"
+#include "scheduler.hpp"
+#include "subpix.hpp"
+#include "videosource.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <numeric>
+#include <random>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+	using Suite = std::function<void(std::ostream&)>;
+
+	double elapsed_us(const Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	}
+
+	struct Distribution {
+		double mean = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+	};
+
+	Distribution summarize(std::vector<double> values)
+	{
+		Distribution d;
+		if (values.empty())
+			return d;
+		std::sort(values.begin(), values.end());
+		auto at = [&](double q) { return values.at(std::min(values.size() - 1, static_cast<size_t>(q * values.size()))); };
+		d.mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+		d.p50 = at(0.5);
+		d.p90 = at(0.9);
+		d.p99 = at(0.99);
+		d.max = values.back();
+		return d;
+	}
+
+	void write_distribution(std::ostream& out, const Distribution& d)
+	{
+		out << "{\"mean\": " << d.mean << ", \"p50\": " << d.p50 << ", \"p90\": " << d.p90
+			<< ", \"p99\": " << d.p99 << ", \"max\": " << d.max << "}";
+	}
+
+	// Renders a board with the given square size under a random perspective, antialiased by
+	// supersampling, blurred and with sensor noise. Returns the exact inner corner positions
+	void render_board(const cv::Size& board_size, const double square_px, std::mt19937& rng, cv::Mat& out, std::vector<cv::Point2f>& truth)
+	{
+		const int ss = 4;
+		const double board_w = (board_size.width + 1) * square_px;
+		const double board_h = (board_size.height + 1) * square_px;
+		const cv::Size canvas(std::max(160, static_cast<int>(board_w * 1.6)), std::max(120, static_cast<int>(board_h * 1.6)));
+		std::uniform_real_distribution<double> jitter(-0.12, 0.12);
+		const double l = (canvas.width - board_w) / 2;
+		const double t = (canvas.height - board_h) / 2;
+		const cv::Point2f dst_lr[] = {
+			cv::Point2f(static_cast<float>(l + jitter(rng) * board_w), static_cast<float>(t + jitter(rng) * board_h)),
+			cv::Point2f(static_cast<float>(l + board_w + jitter(rng) * board_w), static_cast<float>(t + jitter(rng) * board_h)),
+			cv::Point2f(static_cast<float>(l + board_w + jitter(rng) * board_w), static_cast<float>(t + board_h + jitter(rng) * board_h)),
+			cv::Point2f(static_cast<float>(l + jitter(rng) * board_w), static_cast<float>(t + board_h + jitter(rng) * board_h))
+		};
+		cv::Point2f dst_hr[4];
+		for (int i = 0; i < 4; ++i)
+			dst_hr[i] = dst_lr[i] * static_cast<float>(ss) + cv::Point2f((ss - 1) * 0.5f, (ss - 1) * 0.5f);
+		const float bw = static_cast<float>(board_size.width + 1);
+		const float bh = static_cast<float>(board_size.height + 1);
+		const cv::Point2f src[] = {
+			cv::Point2f(-0.5f, -0.5f), cv::Point2f(bw - 0.5f, -0.5f), cv::Point2f(bw - 0.5f, bh - 0.5f), cv::Point2f(-0.5f, bh - 0.5f)
+		};
+		const cv::Mat M = cv::getPerspectiveTransform(src, dst_hr);
+		cv::Mat hr;
+		cv::warpPerspective(generate_board_image(board_size.width, board_size.height), hr, M, canvas * ss,
+			cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(160));
+		cv::resize(hr, out, canvas, 0.0, 0.0, cv::INTER_AREA);
+		cv::GaussianBlur(out, out, cv::Size(0, 0), 0.7);
+		cv::Mat noise(out.size(), CV_16SC1);
+		cv::randn(noise, 0, 2.0);
+		cv::Mat noisy;
+		out.convertTo(noisy, CV_16SC1);
+		noisy += noise;
+		noisy.convertTo(out, CV_8UC1);
+
+		std::vector<cv::Point2f> board_pts;
+		for (int i = 0; i < board_size.height; ++i) {
+			for (int j = 0; j < board_size.width; ++j)
+				board_pts.push_back(cv::Point2f(j + 0.5f, i + 0.5f));
+		}
+		cv::perspectiveTransform(board_pts, truth, M);
+		for (auto& p : truth)
+			p = (p - cv::Point2f((ss - 1) * 0.5f, (ss - 1) * 0.5f)) / static_cast<float>(ss);
+	}
+
+	// Detected corner order depends on board orientation, so errors are taken against the nearest true corner
+	void corner_errors(const std::vector<cv::Point2f>& found, const std::vector<cv::Point2f>& truth, std::vector<double>& errors)
+	{
+		for (auto& p : found) {
+			double best = std::numeric_limits<double>::infinity();
+			for (auto& q : truth)
+				best = std::min(best, cv::norm(p - q));
+			errors.push_back(best);
+		}
+	}
+
+	double rms(const std::vector<double>& values)
+	{
+		if (values.empty())
+			return 0.0;
+		return std::sqrt(std::inner_product(values.begin(), values.end(), values.begin(), 0.0) / values.size());
+	}
+
+	void bench_refinement(std::ostream& out)
+	{
+		const cv::Size board_size(9, 6);
+		const int boards = 40;
+		const double square_sizes[] = { 6, 10, 16, 32, 64 };
+		const cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
+		out << "{\"board\": [" << board_size.width << ", " << board_size.height << "], \"cases\": [";
+		bool first = true;
+		for (double square_px : square_sizes) {
+			std::mt19937 rng(static_cast<unsigned int>(square_px * 1000));
+			std::vector<double> ref_err, new_err, ref_time, new_time;
+			int detected = 0, converged = 0, corners = 0, iterations = 0;
+			for (int b = 0; b < boards; ++b) {
+				cv::Mat img;
+				std::vector<cv::Point2f> truth, initial;
+				render_board(board_size, square_px, rng, img, truth);
+				if (!cv::findChessboardCorners(img, board_size, initial, cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE))
+					continue;
+				++detected;
+				auto reference = initial;
+				auto start = Clock::now();
+				cv::cornerSubPix(img, reference, cv::Size(11, 11), cv::Size(-1, -1), criteria);
+				ref_time.push_back(elapsed_us(start));
+				auto batched = initial;
+				SubpixReport report;
+				start = Clock::now();
+				refine_corners(img, batched, board_size, &report);
+				new_time.push_back(elapsed_us(start));
+				corner_errors(reference, truth, ref_err);
+				corner_errors(batched, truth, new_err);
+				converged += report.num_converged();
+				corners += static_cast<int>(batched.size());
+				iterations += std::accumulate(report.iterations.begin(), report.iterations.end(), 0);
+			}
+			out << (first ? "" : ", ") << "{\"square_px\": " << square_px << ", \"boards\": " << boards << ", \"detected\": " << detected
+				<< ", \"cornersubpix\": {\"rms_px\": " << rms(ref_err) << ", \"max_px\": " << summarize(ref_err).max
+				<< ", \"us_per_board\": " << summarize(ref_time).mean << "}"
+				<< ", \"refine_corners\": {\"rms_px\": " << rms(new_err) << ", \"max_px\": " << summarize(new_err).max
+				<< ", \"us_per_board\": " << summarize(new_time).mean
+				<< ", \"converged_ratio\": " << (corners ? static_cast<double>(converged) / corners : 0.0)
+				<< ", \"mean_iterations\": " << (corners ? static_cast<double>(iterations) / corners : 0.0) << "}}";
+			first = false;
+		}
+		out << "]}";
+	}
+
+	double elapsed_ms(const Clock::time_point start)
+	{
+		return elapsed_us(start) / 1000.0;
+	}
+
+	// The FFmpeg writer takes codec options from the environment, other backends ignore them
+	void set_writer_options(const std::string& options)
+	{
+#ifdef _WIN32
+		_putenv_s("OPENCV_FFMPEG_WRITER_OPTIONS", options.c_str());
+#else
+		if (options.empty())
+			unsetenv("OPENCV_FFMPEG_WRITER_OPTIONS");
+		else
+			setenv("OPENCV_FFMPEG_WRITER_OPTIONS", options.c_str(), 1);
+#endif
+	}
+
+	// Board sweeping across the frame with a slow tilt, so inter codecs see realistic motion
+	void render_sequence_frame(const cv::Mat& board, const int index, const int count, const cv::Size& size, cv::Mat& out)
+	{
+		const double pi = 3.14159265358979323846;
+		const double t = static_cast<double>(index) / std::max(1, count - 1);
+		const double scale = std::min(0.5 * size.width / board.cols, 0.6 * size.height / board.rows);
+		const cv::Point2f center(static_cast<float>(size.width * (0.3 + 0.4 * t)), static_cast<float>(size.height * (0.5 + 0.1 * std::sin(4 * pi * t))));
+		cv::Mat M = cv::getRotationMatrix2D(cv::Point2f(board.cols * 0.5f, board.rows * 0.5f), 20 * std::sin(2 * pi * t), scale);
+		M.at<double>(0, 2) += center.x - board.cols * 0.5;
+		M.at<double>(1, 2) += center.y - board.rows * 0.5;
+		cv::Mat gray(size, CV_8UC1, cv::Scalar(150));
+		cv::warpAffine(board, gray, M, size, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+		cv::Mat noise(size, CV_16SC1);
+		cv::randn(noise, 0, 3.0);
+		cv::Mat noisy;
+		gray.convertTo(noisy, CV_16SC1);
+		noisy += noise;
+		noisy.convertTo(gray, CV_8UC1);
+		cv::cvtColor(gray, out, cv::COLOR_GRAY2BGR);
+	}
+
+	struct VideoCase {
+		const char* codec;
+		const char* container;
+		int gop;
+	};
+
+	// Measures the editor's I/O path through VideoSource on generated clips, one entry per codec and GOP length
+	void bench_video_io(std::ostream& out)
+	{
+		const cv::Size frame_size(640, 360);
+		const cv::Size board_size(9, 6);
+		const int frame_count = 300;
+		const int frame_step = 10;
+		const int seek_samples = 60;
+		const VideoCase cases[] = {
+			{ "MJPG", "avi", 1 },
+			{ "XVID", "avi", 12 },
+			{ "XVID", "avi", 250 },
+			{ "mp4v", "mp4", 12 },
+			{ "mp4v", "mp4", 250 },
+			{ "avc1", "mp4", 12 },
+			{ "avc1", "mp4", 250 }
+		};
+		const StepStrategy strategies[] = { StepStrategy::read, StepStrategy::grab, StepStrategy::seek };
+		const cv::Mat board = generate_board_image(board_size.width, board_size.height);
+		const auto dir = std::filesystem::temp_directory_path();
+
+		out << "{\"frame_size\": [" << frame_size.width << ", " << frame_size.height << "], \"frames\": " << frame_count
+			<< ", \"board\": [" << board_size.width << ", " << board_size.height << "], \"frame_step\": " << frame_step << ", \"videos\": [";
+		bool first = true;
+		for (auto& c : cases) {
+			out << (first ? "" : ", ") << "{\"codec\": \"" << c.codec << "\", \"container\": \"" << c.container << "\", \"gop\": " << c.gop;
+			first = false;
+			const std::string path = (dir / ("calibration_bench_" + std::string(c.codec) + "_g" + std::to_string(c.gop) + "." + c.container)).string();
+			set_writer_options("g;" + std::to_string(c.gop));
+			cv::VideoWriter writer(path, cv::VideoWriter::fourcc(c.codec[0], c.codec[1], c.codec[2], c.codec[3]), 30.0, frame_size, true);
+			set_writer_options("");
+			if (!writer.isOpened()) {
+				out << ", \"available\": false}";
+				continue;
+			}
+			std::mt19937 rng(1);
+			cv::Mat frame_bgr;
+			for (int i = 0; i < frame_count; ++i) {
+				render_sequence_frame(board, i, frame_count, frame_size, frame_bgr);
+				writer.write(frame_bgr);
+			}
+			writer.release();
+
+			VideoSource video;
+			if (!video.open(path, false)) {
+				out << ", \"available\": false}";
+				std::filesystem::remove(path);
+				continue;
+			}
+			const int total = video.total_frames();
+			VideoFrame frame;
+
+			// Sequential playback the way the editor does it, decoding into pooled buffers
+			FramePool pool;
+			FrameRef shown;
+			int decoded = 0;
+			auto start = Clock::now();
+			while (true) {
+				auto next = pool.acquire();
+				if (!video.step(1, StepStrategy::read, *next))
+					break;
+				shown = std::move(next);
+				++decoded;
+			}
+			const double decode_ms = elapsed_ms(start);
+			shown.reset();
+			const auto pool_stats = pool.stats();
+
+			std::uniform_int_distribution<int> pick(1, std::max(1, total));
+			std::vector<double> seek_ms;
+			int seek_misses = 0;
+			for (int i = 0; i < seek_samples; ++i) {
+				const int pos = pick(rng);
+				start = Clock::now();
+				const bool ok = video.set_pos(pos, frame);
+				seek_ms.push_back(elapsed_ms(start));
+				if (!ok || video.current_pos() != pos)
+					++seek_misses;
+			}
+
+			// Mirrors prev_frame: the step back from a freshly read frame always needs a seek
+			std::vector<double> back_ms;
+			for (int i = 0; i < seek_samples; ++i) {
+				const int pos = std::max(2, pick(rng));
+				if (!video.set_pos(pos, frame))
+					continue;
+				start = Clock::now();
+				video.set_pos(pos - 1, frame);
+				back_ms.push_back(elapsed_ms(start));
+			}
+
+			out << ", \"available\": true, \"bytes\": " << std::filesystem::file_size(path) << ", \"frames_reported\": " << total
+				<< ", \"decode_fps\": " << (decode_ms > 0 ? decoded * 1000.0 / decode_ms : 0.0)
+				<< ", \"decode_buffers\": " << pool_stats.buffers << ", \"decode_allocations\": " << pool_stats.allocations
+				<< ", \"seek_ms\": ";
+			write_distribution(out, summarize(seek_ms));
+			out << ", \"seek_misses\": " << seek_misses << ", \"backward_step_ms\": ";
+			write_distribution(out, summarize(back_ms));
+
+			// Same loop shape as window::auto_detect_boards, detection included
+			out << ", \"auto_detect\": {";
+			bool first_strategy = true;
+			for (auto strategy : strategies) {
+				const int reopens = video.reopen_count();
+				int analysed = 0, boards = 0;
+				start = Clock::now();
+				bool success = video.set_pos(1, frame);
+				for (int i = 0; i < std::max(1, total / frame_step); ++i) {
+					if (i > 0)
+						success = video.step(frame_step, strategy, frame);
+					if (!success)
+						continue;
+					++analysed;
+					if (get_corners(frame.detection_image(), board_size.width, board_size.height).valid)
+						++boards;
+				}
+				const double scan_ms = elapsed_ms(start);
+				out << (first_strategy ? "" : ", ") << "\"" << step_strategy_name(strategy) << "\": {\"source_fps\": "
+					<< (scan_ms > 0 ? analysed * frame_step * 1000.0 / scan_ms : 0.0)
+					<< ", \"analysed_fps\": " << (scan_ms > 0 ? analysed * 1000.0 / scan_ms : 0.0)
+					<< ", \"analysed\": " << analysed << ", \"boards\": " << boards
+					<< ", \"reopens\": " << video.reopen_count() - reopens << "}";
+				first_strategy = false;
+			}
+			out << "}}";
+			video.release();
+			std::filesystem::remove(path);
+		}
+		out << "]}";
+	}
+
+	// Board-free scene of overlapping shapes and lines on a lighting ramp, with sensor noise
+	void render_clutter(const cv::Size& size, std::mt19937& rng, cv::Mat& out)
+	{
+		std::uniform_int_distribution<int> level(20, 235), px(0, size.width - 1), py(0, size.height - 1), extent(8, size.width / 5), kind(0, 2);
+		cv::Mat gray(size, CV_8UC1);
+		const int left = level(rng), right = level(rng);
+		for (int x = 0; x < size.width; ++x)
+			gray.col(x).setTo(cv::Scalar(left + (right - left) * x / size.width));
+		for (int i = 0; i < 60; ++i) {
+			const cv::Point p(px(rng), py(rng));
+			const cv::Scalar color(level(rng));
+			switch (kind(rng)) {
+			case 0:
+				cv::rectangle(gray, cv::Rect(p, cv::Size(extent(rng), extent(rng))), color, cv::FILLED);
+				break;
+			case 1:
+				cv::circle(gray, p, extent(rng) / 2, color, cv::FILLED, cv::LINE_AA);
+				break;
+			default:
+				cv::line(gray, p, cv::Point(px(rng), py(rng)), color, 1 + extent(rng) / 20, cv::LINE_AA);
+			}
+		}
+		cv::GaussianBlur(gray, gray, cv::Size(0, 0), 1.0);
+		cv::Mat noise(size, CV_16SC1);
+		cv::randn(noise, 0, 3.0);
+		cv::Mat noisy;
+		gray.convertTo(noisy, CV_16SC1);
+		noisy += noise;
+		noisy.convertTo(out, CV_8UC1);
+	}
+
+	// Presence test against the full detector on frames with whole boards, boards cut by the frame
+	// edge and clutter. The detector's verdict is the label
+	void bench_presence(std::ostream& out)
+	{
+		const cv::Size frame_size(1280, 720);
+		const cv::Size board_size(9, 6);
+		const int frame_count = 240;
+		const cv::Mat board = generate_board_image(board_size.width, board_size.height);
+		std::mt19937 rng(3);
+
+		std::vector<double> presence_us, positive_us, negative_us;
+		int positives = 0, negatives = 0, false_negatives = 0, rejected_negatives = 0;
+		double accepted_detect_us = 0.0;
+		cv::Mat frame_bgr, frame;
+		for (int i = 0; i < frame_count; ++i) {
+			if (i % 3 == 2) {
+				render_clutter(frame_size, rng, frame);
+			}
+			else {
+				render_sequence_frame(board, i, frame_count, frame_size, frame_bgr);
+				cv::cvtColor(frame_bgr, frame, cv::COLOR_BGR2GRAY);
+				if (i % 3 == 1) {
+					// Pushes about half the board out of the frame
+					const cv::Matx23d shift(1, 0, frame_size.width * 0.35, 0, 1, 0);
+					cv::warpAffine(frame, frame, shift, frame_size, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(150));
+				}
+			}
+
+			auto start = Clock::now();
+			const bool plausible = board_plausible(frame, board_size);
+			presence_us.push_back(elapsed_us(start));
+			start = Clock::now();
+			const bool found = get_corners(frame, board_size.width, board_size.height).valid;
+			const double detect_us = elapsed_us(start);
+			(found ? positive_us : negative_us).push_back(detect_us);
+			if (plausible)
+				accepted_detect_us += detect_us;
+			if (found) {
+				++positives;
+				if (!plausible)
+					++false_negatives;
+			}
+			else {
+				++negatives;
+				if (!plausible)
+					++rejected_negatives;
+			}
+		}
+
+		const double detect_total = std::accumulate(positive_us.begin(), positive_us.end(), 0.0) + std::accumulate(negative_us.begin(), negative_us.end(), 0.0);
+		const double filtered_total = std::accumulate(presence_us.begin(), presence_us.end(), 0.0) + accepted_detect_us;
+		out << "{\"frame_size\": [" << frame_size.width << ", " << frame_size.height << "], \"board\": [" << board_size.width << ", " << board_size.height
+			<< "], \"frames\": " << frame_count << ", \"positives\": " << positives << ", \"negatives\": " << negatives
+			<< ", \"reject_rate\": " << (negatives ? static_cast<double>(rejected_negatives) / negatives : 0.0)
+			<< ", \"false_negative_rate\": " << (positives ? static_cast<double>(false_negatives) / positives : 0.0)
+			<< ", \"presence_us\": ";
+		write_distribution(out, summarize(presence_us));
+		out << ", \"detect_positive_us\": ";
+		write_distribution(out, summarize(positive_us));
+		out << ", \"detect_negative_us\": ";
+		write_distribution(out, summarize(negative_us));
+		out << ", \"scan_speedup\": " << (filtered_total > 0 ? detect_total / filtered_total : 0.0) << "}";
+	}
+
+	// A 9x6 board under random poses in front of a distorted 1080p camera, with noisy detections
+	void synthetic_views(const int count, std::mt19937& rng, const Kk& cam_Kk, std::vector<ChessboardCorners>& views, std::vector<ViewPose>& poses)
+	{
+		std::uniform_real_distribution<double> angle(-0.5, 0.5), shift(-3.0, 3.0), depth(10.0, 20.0);
+		std::normal_distribution<float> noise(0.0f, 0.3f);
+		for (int i = 0; i < count; ++i) {
+			ChessboardCorners c(9, 6);
+			c.src_img_size = cv::Size(1920, 1080);
+			c.valid = true;
+			ViewPose pose{ cv::Vec3d(angle(rng), angle(rng), angle(rng)), cv::Vec3d(shift(rng) - 4, shift(rng) - 2.5, depth(rng)) };
+			cv::projectPoints(c.obj_corners, pose.rvec, pose.tvec, cam_Kk.K, cam_Kk.dist_vector(), c.img_corners);
+			for (auto& p : c.img_corners)
+				p += cv::Point2f(noise(rng), noise(rng));
+			views.push_back(c);
+			poses.push_back(pose);
+		}
+	}
+
+	// Validates the radial reprojection kernel against cv::projectPoints and times both the
+	// way calibrate_camera used to evaluate errors and the kernel with a reused output
+	void bench_reprojection(std::ostream& out)
+	{
+		Kk cam_Kk;
+		cam_Kk.K = cv::Matx33d(1400, 0, 960, 0, 1400, 540, 0, 0, 1);
+		cam_Kk.k = cv::Matx13d(-0.2, 0.05, -0.01);
+		const int view_counts[] = { 10, 100, 1000 };
+		out << "{\"board\": [9, 6], \"cases\": [";
+		bool first = true;
+		for (int count : view_counts) {
+			std::mt19937 rng(static_cast<unsigned int>(count));
+			std::vector<ChessboardCorners> views;
+			std::vector<ViewPose> poses;
+			synthetic_views(count, rng, cam_Kk, views, poses);
+			const auto dist = cam_Kk.dist_vector();
+
+			std::vector<double> ref_view(views.size());
+			std::vector<std::vector<float>> ref_corner(views.size());
+			auto reference = [&]() {
+				TaskScheduler::global().parallel_for(0, views.size(), [&](size_t i) {
+					std::vector<cv::Point2f> reproj;
+					cv::projectPoints(views.at(i).obj_corners, poses.at(i).rvec, poses.at(i).tvec, cam_Kk.K, dist, reproj);
+					ref_view.at(i) = cv::norm(views.at(i).img_corners, reproj, cv::NORM_L2) / reproj.size();
+					ref_corner.at(i).resize(reproj.size());
+					for (size_t j = 0; j < reproj.size(); ++j)
+						ref_corner.at(i).at(j) = static_cast<float>(cv::norm(views.at(i).img_corners.at(j) - reproj.at(j)));
+				});
+			};
+			ReprojectionErrors errors;
+			auto kernel = [&]() { reprojection_errors(cam_Kk, views, poses, errors); };
+
+			const int reps = std::max(5, 20000 / count);
+			std::vector<double> ref_time, kernel_time;
+			for (int r = 0; r < reps; ++r) {
+				auto start = Clock::now();
+				reference();
+				ref_time.push_back(elapsed_us(start));
+				start = Clock::now();
+				kernel();
+				kernel_time.push_back(elapsed_us(start));
+			}
+
+			double max_corner_diff = 0.0, max_view_diff = 0.0;
+			for (size_t i = 0; i < views.size(); ++i) {
+				max_view_diff = std::max(max_view_diff, std::abs(errors.view.at(i) - ref_view.at(i)));
+				for (size_t j = 0; j < ref_corner.at(i).size(); ++j)
+					max_corner_diff = std::max(max_corner_diff, static_cast<double>(std::abs(errors.corner.at(errors.offsets.at(i) + j) - ref_corner.at(i).at(j))));
+			}
+			const double kernel_us = summarize(kernel_time).p50;
+			out << (first ? "" : ", ") << "{\"views\": " << count << ", \"corners\": " << errors.corner.size()
+				<< ", \"max_corner_diff_px\": " << max_corner_diff << ", \"max_view_diff_px\": " << max_view_diff
+				<< ", \"projectpoints_us\": " << summarize(ref_time).p50 << ", \"kernel_us\": " << kernel_us
+				<< ", \"kernel_ns_per_corner\": " << (errors.corner.empty() ? 0.0 : kernel_us * 1000.0 / errors.corner.size()) << "}";
+			first = false;
+		}
+		out << "]}";
+	}
+
+	void write_intrinsics(std::ostream& out, const Kk& cam_Kk)
+	{
+		out << "{\"fx\": " << cam_Kk.K(0, 0) << ", \"fy\": " << cam_Kk.K(1, 1) << ", \"cx\": " << cam_Kk.K(0, 2) << ", \"cy\": " << cam_Kk.K(1, 2)
+			<< ", \"k1\": " << cam_Kk.k(0) << ", \"k2\": " << cam_Kk.k(1) << ", \"k3\": " << cam_Kk.k(2) << "}";
+	}
+
+	double max_intrinsics_diff(const Kk& a, const Kk& b, double& k_diff)
+	{
+		k_diff = std::max({ std::abs(a.k(0) - b.k(0)), std::abs(a.k(1) - b.k(1)), std::abs(a.k(2) - b.k(2)) });
+		return std::max({ std::abs(a.K(0, 0) - b.K(0, 0)), std::abs(a.K(1, 1) - b.K(1, 1)), std::abs(a.K(0, 2) - b.K(0, 2)), std::abs(a.K(1, 2) - b.K(1, 2)) });
+	}
+
+	// Compares the bundle solver with cv::calibrateCamera restricted to the same model, cold and
+	// warm started from a solve on half of the views
+	void bench_solver(std::ostream& out)
+	{
+		Kk truth;
+		truth.K = cv::Matx33d(1400, 0, 960, 0, 1400, 540, 0, 0, 1);
+		truth.k = cv::Matx13d(-0.2, 0.05, -0.01);
+		const cv::Size img_size(1920, 1080);
+		const int view_counts[] = { 10, 50, 200, 500 };
+		out << "{\"truth\": ";
+		write_intrinsics(out, truth);
+		out << ", \"cases\": [";
+		bool first = true;
+		for (int count : view_counts) {
+			std::mt19937 rng(static_cast<unsigned int>(count) + 7);
+			std::vector<ChessboardCorners> views;
+			std::vector<ViewPose> poses;
+			synthetic_views(count, rng, truth, views, poses);
+			std::vector<std::vector<cv::Point2f>> imgp;
+			std::vector<std::vector<cv::Point3f>> objp;
+			for (auto& v : views) {
+				imgp.push_back(v.img_corners);
+				objp.push_back(v.obj_corners);
+			}
+
+			Kk opencv;
+			std::vector<double> dist;
+			std::vector<cv::Mat> rvecs, tvecs;
+			auto start = Clock::now();
+			const double opencv_rms = cv::calibrateCamera(objp, imgp, img_size, opencv.K, dist, rvecs, tvecs, cv::CALIB_ZERO_TANGENT_DIST);
+			const double opencv_ms = elapsed_us(start) / 1000.0;
+			opencv.k = cv::Matx13d(dist.at(0), dist.at(1), dist.at(4));
+
+			start = Clock::now();
+			auto cold = solve_bundle(views, img_size);
+			const double cold_ms = elapsed_us(start) / 1000.0;
+
+			std::vector<ChessboardCorners> half(views.begin(), views.begin() + count / 2);
+			auto seed = solve_bundle(half, img_size);
+			seed.poses.clear();
+			start = Clock::now();
+			auto warm = solve_bundle(views, img_size, &seed);
+			const double warm_ms = elapsed_us(start) / 1000.0;
+
+			double k_diff = 0.0;
+			const double K_diff = max_intrinsics_diff(cold.cam_Kk, opencv, k_diff);
+			out << (first ? "" : ", ") << "{\"views\": " << count
+				<< ", \"opencv\": {\"ms\": " << opencv_ms << ", \"rms_px\": " << opencv_rms << ", \"intrinsics\": ";
+			write_intrinsics(out, opencv);
+			out << "}, \"bundle\": {\"ms\": " << cold_ms << ", \"iterations\": " << cold.iterations << ", \"rms_px\": " << cold.rms
+				<< ", \"success\": " << (cold.success ? "true" : "false") << ", \"intrinsics\": ";
+			write_intrinsics(out, cold.cam_Kk);
+			out << "}, \"bundle_warm\": {\"ms\": " << warm_ms << ", \"iterations\": " << warm.iterations << ", \"rms_px\": " << warm.rms
+				<< "}, \"max_K_diff_px\": " << K_diff << ", \"max_k_diff\": " << k_diff << "}";
+			first = false;
+		}
+		out << "]}";
+	}
+
+	const std::vector<std::pair<std::string, Suite>>& suite_table()
+	{
+		static const std::vector<std::pair<std::string, Suite>> table = {
+			{ "refinement", bench_refinement },
+			{ "video_io", bench_video_io },
+			{ "presence", bench_presence },
+			{ "reprojection", bench_reprojection },
+			{ "solver", bench_solver }
+		};
+		return table;
+	}
+}
+
+const std::vector<std::string> benchmark_suites()
+{
+	std::vector<std::string> names;
+	for (auto& s : suite_table())
+		names.push_back(s.first);
+	return names;
+}
+
+int run_benchmarks(const std::vector<std::string>& suites, std::ostream& out)
+{
+	std::vector<std::string> selected = suites;
+	if (selected.empty() || std::find(selected.begin(), selected.end(), "all") != selected.end())
+		selected = benchmark_suites();
+	for (auto& name : selected) {
+		auto& table = suite_table();
+		if (std::none_of(table.begin(), table.end(), [&](auto& s) { return s.first == name; }))
+			return 1;
+	}
+	out << "{\"suites\": {";
+	bool first = true;
+	for (auto& s : suite_table()) {
+		if (std::find(selected.begin(), selected.end(), s.first) == selected.end())
+			continue;
+		out << (first ? "" : ", ") << "\"" << s.first << "\": ";
+		s.second(out);
+		out.flush();
+		first = false;
+	}
+	out << "}}" << std::endl;
+	return 0;
+}
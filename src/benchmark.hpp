@@ -0,0 +1,10 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Headless benchmark suites. Results are written as a single JSON document
+const std::vector<std::string> benchmark_suites();
+
+int run_benchmarks(const std::vector<std::string>& suites, std::ostream& out);
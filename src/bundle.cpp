@@ -0,0 +1,212 @@
+#include "bundle.hpp"
+#include "scheduler.hpp"
+#include <Eigen/Dense>
+#include <cmath>
+
+namespace {
+	using Mat77 = Eigen::Matrix<double, 7, 7>;
+	using Mat66 = Eigen::Matrix<double, 6, 6>;
+	using Mat76 = Eigen::Matrix<double, 7, 6>;
+	using Vec7 = Eigen::Matrix<double, 7, 1>;
+	using Vec6 = Eigen::Matrix<double, 6, 1>;
+
+	// Normal equation blocks of one view: intrinsics (U), pose (V) and their coupling (W)
+	struct ViewSystem {
+		Mat77 U;
+		Mat66 V;
+		Mat76 W;
+		Vec7 ga;
+		Vec6 gp;
+		Mat66 V_inv;
+		Mat76 WV_inv;
+	};
+
+	Vec7 pack(const Kk& cam_Kk)
+	{
+		Vec7 a;
+		a << cam_Kk.K(0, 0), cam_Kk.K(1, 1), cam_Kk.K(0, 2), cam_Kk.K(1, 2), cam_Kk.k(0), cam_Kk.k(1), cam_Kk.k(2);
+		return a;
+	}
+
+	Kk unpack(const Vec7& a)
+	{
+		Kk out;
+		out.K = cv::Matx33d(a(0), 0, a(2), 0, a(1), a(3), 0, 0, 1);
+		out.k = cv::Matx13d(a(4), a(5), a(6));
+		return out;
+	}
+
+	// Analytic Jacobians of the residuals of one view. The rotation is perturbed on the left,
+	// R <- exp([dw]) R, so d(RP + t)/d(dw) = -[RP]x and d(RP + t)/dt = I
+	void linearize(const Vec7& a, const ViewPose& pose, const ChessboardCorners& view, ViewSystem& s)
+	{
+		s.U.setZero();
+		s.V.setZero();
+		s.W.setZero();
+		s.ga.setZero();
+		s.gp.setZero();
+		const double fx = a(0), fy = a(1), cx = a(2), cy = a(3), k1 = a(4), k2 = a(5), k3 = a(6);
+		const cv::Matx33d R = rotation_matrix(pose.rvec);
+		Eigen::Matrix<double, 2, 7> Ja;
+		Eigen::Matrix<double, 2, 6> Jp;
+		Eigen::Matrix<double, 2, 3> Jx;
+		const size_t n = std::min(view.obj_corners.size(), view.img_corners.size());
+		for (size_t j = 0; j < n; ++j) {
+			const auto& P = view.obj_corners.at(j);
+			const cv::Vec3d RP = R * cv::Vec3d(P.x, P.y, P.z);
+			const cv::Vec3d X = RP + pose.tvec;
+			const double iz = 1.0 / X(2);
+			const double x = X(0) * iz, y = X(1) * iz;
+			const double r2 = x * x + y * y;
+			const double f = 1 + r2 * (k1 + r2 * (k2 + r2 * k3));
+			const double fp2 = 2 * (k1 + r2 * (2 * k2 + 3 * r2 * k3));
+			const double xd = x * f, yd = y * f;
+			const Eigen::Vector2d r(fx * xd + cx - view.img_corners.at(j).x, fy * yd + cy - view.img_corners.at(j).y);
+
+			// d(u, v)/d(x, y) = diag(fx, fy) * (f * I + f' * 2 * [x y]^T [x y])
+			const double d00 = fx * (f + fp2 * x * x), d01 = fx * fp2 * x * y;
+			const double d10 = fy * fp2 * x * y, d11 = fy * (f + fp2 * y * y);
+			// d(x, y)/dX
+			Jx << d00 * iz, d01 * iz, -(d00 * x + d01 * y) * iz,
+				d10 * iz, d11 * iz, -(d10 * x + d11 * y) * iz;
+			Eigen::Matrix3d skew;
+			skew << 0, -RP(2), RP(1),
+				RP(2), 0, -RP(0),
+				-RP(1), RP(0), 0;
+			Jp.leftCols<3>() = -Jx * skew;
+			Jp.rightCols<3>() = Jx;
+
+			const double r4 = r2 * r2;
+			Ja << xd, 0, 1, 0, fx * x * r2, fx * x * r4, fx * x * r4 * r2,
+				0, yd, 0, 1, fy * y * r2, fy * y * r4, fy * y * r4 * r2;
+
+			s.U.noalias() += Ja.transpose() * Ja;
+			s.V.noalias() += Jp.transpose() * Jp;
+			s.W.noalias() += Ja.transpose() * Jp;
+			s.ga.noalias() += Ja.transpose() * r;
+			s.gp.noalias() += Jp.transpose() * r;
+		}
+	}
+
+	double total_cost(const Kk& cam_Kk, const std::vector<ChessboardCorners>& views, const std::vector<ViewPose>& poses, ReprojectionErrors& errors)
+	{
+		reprojection_errors(cam_Kk, views, poses, errors);
+		double cost = 0.0;
+		for (size_t i = 0; i < errors.view_rms.size(); ++i)
+			cost += errors.view_rms.at(i) * errors.view_rms.at(i) * (errors.offsets.at(i + 1) - errors.offsets.at(i));
+		return cost;
+	}
+
+	const ViewPose apply_step(const ViewPose& pose, const Vec6& d)
+	{
+		const cv::Matx33d R = rotation_matrix(cv::Vec3d(d(0), d(1), d(2))) * rotation_matrix(pose.rvec);
+		ViewPose out;
+		cv::Rodrigues(R, out.rvec);
+		out.tvec = pose.tvec + cv::Vec3d(d(3), d(4), d(5));
+		return out;
+	}
+}
+
+const BundleResult solve_bundle(const std::vector<ChessboardCorners>& views, const cv::Size& img_size,
+	const BundleResult* warm_start, const BundleOptions& options)
+{
+	BundleResult result;
+	if (views.empty() || img_size.empty())
+		return result;
+	std::vector<std::vector<cv::Point3f>> objp;
+	std::vector<std::vector<cv::Point2f>> imgp;
+	for (auto& v : views) {
+		objp.push_back(v.obj_corners);
+		imgp.push_back(v.img_corners);
+	}
+
+	// Cold starts take K from the board homographies and poses from a distortion free PnP
+	Kk cam_Kk;
+	if (warm_start && warm_start->success)
+		cam_Kk = warm_start->cam_Kk;
+	else
+		cam_Kk.K = cv::Matx33d(cv::initCameraMatrix2D(objp, imgp, img_size));
+	std::vector<ViewPose> poses(views.size());
+	if (warm_start && warm_start->success && warm_start->poses.size() == views.size())
+		poses = warm_start->poses;
+	else {
+		const auto dist = cam_Kk.dist_vector();
+		TaskScheduler::global().parallel_for(0, views.size(), [&](size_t i) {
+			cv::Mat rvec, tvec;
+			cv::solvePnP(objp.at(i), imgp.at(i), cam_Kk.K, dist, rvec, tvec);
+			poses.at(i) = ViewPose{ cv::Vec3d(rvec), cv::Vec3d(tvec) };
+		});
+	}
+
+	ReprojectionErrors errors;
+	Vec7 a = pack(cam_Kk);
+	double cost = total_cost(cam_Kk, views, poses, errors);
+	std::vector<ViewSystem> systems(views.size());
+	std::vector<ViewPose> trial_poses(views.size());
+	std::vector<Vec6> pose_steps(views.size());
+	double lambda = 1e-3;
+	bool relinearize = true;
+	for (result.iterations = 0; result.iterations < options.max_iter; ++result.iterations) {
+		if (relinearize) {
+			TaskScheduler::global().parallel_for(0, views.size(), [&](size_t i) {
+				linearize(a, poses.at(i), views.at(i), systems.at(i));
+			});
+		}
+
+		// Marquardt damping on the diagonal, then eliminate the pose blocks view by view
+		std::vector<Mat77> reduced_U(views.size());
+		std::vector<Vec7> reduced_g(views.size());
+		TaskScheduler::global().parallel_for(0, views.size(), [&](size_t i) {
+			auto& s = systems.at(i);
+			Mat66 V = s.V;
+			V.diagonal() += lambda * s.V.diagonal() + Vec6::Constant(1e-12);
+			s.V_inv = V.ldlt().solve(Mat66::Identity());
+			s.WV_inv = s.W * s.V_inv;
+			reduced_U.at(i) = s.U - s.WV_inv * s.W.transpose();
+			reduced_g.at(i) = s.ga - s.WV_inv * s.gp;
+		});
+		Mat77 S = Mat77::Zero();
+		Mat77 U_diag = Mat77::Zero();
+		Vec7 b = Vec7::Zero();
+		for (size_t i = 0; i < views.size(); ++i) {
+			S += reduced_U.at(i);
+			U_diag.diagonal() += systems.at(i).U.diagonal();
+			b -= reduced_g.at(i);
+		}
+		S.diagonal() += lambda * U_diag.diagonal() + Vec7::Constant(1e-12);
+		const Vec7 da = S.ldlt().solve(b);
+		for (size_t i = 0; i < views.size(); ++i) {
+			auto& s = systems.at(i);
+			pose_steps.at(i) = s.V_inv * (-s.gp - s.W.transpose() * da);
+			trial_poses.at(i) = apply_step(poses.at(i), pose_steps.at(i));
+		}
+		const Vec7 trial_a = a + da;
+		const double trial_cost = total_cost(unpack(trial_a), views, trial_poses, errors);
+
+		if (std::isfinite(trial_cost) && trial_cost < cost) {
+			const double decrease = (cost - trial_cost) / std::max(cost, 1e-300);
+			a = trial_a;
+			poses.swap(trial_poses);
+			cost = trial_cost;
+			lambda = std::max(lambda / 10, 1e-12);
+			relinearize = true;
+			if (decrease < options.tolerance)
+				break;
+		}
+		else {
+			lambda *= 10;
+			relinearize = false;
+			if (lambda > 1e12)
+				break;
+		}
+	}
+
+	size_t corners = 0;
+	for (auto& v : views)
+		corners += v.img_corners.size();
+	result.cam_Kk = unpack(a);
+	result.poses = poses;
+	result.rms = std::sqrt(cost / std::max<size_t>(1, corners));
+	result.success = std::isfinite(result.rms) && a(0) > 0 && a(1) > 0;
+	return result;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "calibration.hpp"
+#include "reprojection.hpp"
+#include <vector>
+
+struct BundleOptions {
+	int max_iter = 100;
+	// Stops once an accepted step lowers the cost by less than this fraction
+	double tolerance = 1e-10;
+};
+
+struct BundleResult {
+	Kk cam_Kk;
+	std::vector<ViewPose> poses;
+	double rms = std::numeric_limits<double>::infinity();
+	int iterations = 0;
+	bool success = false;
+};
+
+// Levenberg-Marquardt bundle adjustment of fx, fy, cx, cy, K1..K3 and one pose per view, the exact
+// model exported by the application. The per-view pose blocks are eliminated through the Schur
+// complement, so every iteration solves a 7x7 system and scales linearly with the view count.
+// A successful warm_start seeds the intrinsics, and the poses too when it covers the same views
+const BundleResult solve_bundle(const std::vector<ChessboardCorners>& views, const cv::Size& img_size,
+	const BundleResult* warm_start = nullptr, const BundleOptions& options = BundleOptions());
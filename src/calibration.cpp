@@ -1,7 +1,13 @@
 #include "calibration.hpp"
+#include "bundle.hpp"
+#include "reprojection.hpp"
+#include "scheduler.hpp"
+#include "subpix.hpp"
 #include <algorithm>
-#include <execution>
+#include <chrono>
 #include <numeric>
+#include <optional>
+#include <random>
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/geometries.hpp>
 #include <boost/geometry/geometries/point_xy.hpp>
@@ -20,6 +26,37 @@ const std::vector<float> Kk::dist_vector() const {
 	return out;
 }
 
+const cv::Point2d Kk::distort_point(const cv::Point2d& p) const
+{
+	const double r2 = p.x * p.x + p.y * p.y;
+	return p * (1 + r2 * (k(0) + r2 * (k(1) + r2 * k(2))));
+}
+
+bool Kk::undistort_point(const cv::Point2d& p, const cv::Point2d& guess, cv::Point2d& out, const int max_iter, const double eps) const
+{
+	// d(x * f(r2))/dx = f * I + 2 * f'(r2) * x * x^T
+	cv::Point2d x = guess;
+	for (int i = 0; i < max_iter; ++i) {
+		const double r2 = x.x * x.x + x.y * x.y;
+		const double f = 1 + r2 * (k(0) + r2 * (k(1) + r2 * k(2)));
+		const double df = 2 * (k(0) + r2 * (2 * k(1) + 3 * r2 * k(2)));
+		const cv::Point2d e = x * f - p;
+		const double j00 = f + df * x.x * x.x;
+		const double j01 = df * x.x * x.y;
+		const double j11 = f + df * x.y * x.y;
+		const double det = j00 * j11 - j01 * j01;
+		if (!(std::abs(det) > 1e-12))
+			return false;
+		const cv::Point2d step((j11 * e.x - j01 * e.y) / det, (j00 * e.y - j01 * e.x) / det);
+		x -= step;
+		if (step.dot(step) < eps * eps) {
+			out = x;
+			return std::isfinite(x.x) && std::isfinite(x.y);
+		}
+	}
+	return false;
+}
+
 ChessboardCorners::ChessboardCorners(int width, int height)
 {
 	width = std::abs(width);
@@ -88,10 +125,49 @@ void CalibrationResult::undistort(cv::Mat& image) const
 	if (!this->success)
 		return;
 	cv::Mat map_a, map_b;
-	cv::initUndistortRectifyMap(this->cam_Kk.K, this->cam_Kk.dist_vector(), cv::Mat(), this->cam_Kk.K, cv::Size(image.cols, image.rows), CV_32FC1, map_a, map_b);
+	undistort_maps(cv::Size(image.cols, image.rows), map_a, map_b);
 	cv::remap(image, image, map_a, map_b, cv::INTER_LINEAR);
 }
 
+void CalibrationResult::undistort_maps(const cv::Size& size, cv::Mat& map_a, cv::Mat& map_b) const
+{
+	undistort_maps(size, size, map_a, map_b);
+}
+
+void CalibrationResult::undistort_maps(const cv::Size& src_size, const cv::Size& dst_size, cv::Mat& map_a, cv::Mat& map_b) const
+{
+	// Maps are built directly at the requested resolution by scaling K, so callers
+	// working on downscaled frames never have to touch a full resolution image.
+	// With differing sizes the maps resample while undistorting, reading src_size frames
+	cv::initUndistortRectifyMap(scaled_K(src_size), this->cam_Kk.dist_vector(), cv::Mat(), scaled_K(dst_size), dst_size, CV_16SC2, map_a, map_b);
+}
+
+const cv::Matx33d CalibrationResult::scaled_K(const cv::Size& size) const
+{
+	cv::Matx33d K = this->cam_Kk.K;
+	if (!this->src_img_size.empty()) {
+		const double sx = static_cast<double>(size.width) / this->src_img_size.width;
+		const double sy = static_cast<double>(size.height) / this->src_img_size.height;
+		K(0, 0) *= sx;
+		K(0, 1) *= sx;
+		K(0, 2) *= sx;
+		K(1, 1) *= sy;
+		K(1, 2) *= sy;
+	}
+	return K;
+}
+
+const cv::Point2f CalibrationResult::distort_pixel(const cv::Point2f& p, const cv::Size& size) const
+{
+	if (!this->success)
+		return p;
+	const cv::Matx33d K = scaled_K(size);
+	const double y = (p.y - K(1, 2)) / K(1, 1);
+	const cv::Point2d n((p.x - K(0, 2) - K(0, 1) * y) / K(0, 0), y);
+	const cv::Point2d d = this->cam_Kk.distort_point(n);
+	return cv::Point2f(static_cast<float>(K(0, 0) * d.x + K(0, 1) * d.y + K(0, 2)), static_cast<float>(K(1, 1) * d.y + K(1, 2)));
+}
+
 const double CalibrationResult::h_ratio() const
 {
 	if (!this->success)
@@ -115,29 +191,116 @@ const double CalibrationResult::focal_length(double sensor_width) const
 
 const ChessboardCorners get_corners(const cv::Mat& image, const int board_width, const int board_height) {
 	ChessboardCorners result(board_width, board_height);
+	// Scanning threads convert every frame at the same size, so the gray buffer is kept per thread
+	thread_local cv::Mat gray_buffer;
 	cv::Mat gray_img;
-	cv::cvtColor(image, gray_img, cv::COLOR_BGR2GRAY);
+	if (image.channels() == 1)
+		gray_img = image;
+	else {
+		cv::cvtColor(image, gray_buffer, cv::COLOR_BGR2GRAY);
+		gray_img = gray_buffer;
+	}
 	const bool success = cv::findChessboardCorners(gray_img, cv::Size(board_width, board_height), result.img_corners,
 		cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK);
 	if (!success)
 		return result;
 	result.valid = true;
 	result.src_img_size = cv::Size(image.cols, image.rows);
-	const cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
-	cv::cornerSubPix(gray_img, result.img_corners, cv::Size(11, 11), cv::Size(-1, -1), criteria);
+	refine_corners(gray_img, result.img_corners, result.board_size);
 	return result;
 }
 
 const std::vector<ChessboardCorners> get_corners(const std::vector<cv::Mat>& images, const int board_width, const int board_height) {
 	std::vector<ChessboardCorners> result(images.size(), ChessboardCorners(0, 0));
-	std::vector<size_t> img_idx(images.size());
-	std::iota(img_idx.begin(), img_idx.end(), 0);
-	std::for_each(std::execution::par_unseq, img_idx.begin(), img_idx.end(), [&](size_t i) {
+	TaskScheduler::global().parallel_for(0, images.size(), [&](size_t i) {
 		result.at(i) = get_corners(images.at(i), board_width, board_height);
 	});
 	return result;
 }
 
+const cv::Size infer_board_size(const std::vector<cv::Mat>& images, const cv::Size& min_size, const cv::Size& max_size, const int min_hits, const SolveProgress& progress, const cv::Size& preferred)
+{
+	if (images.empty())
+		return cv::Size();
+	auto& scheduler = TaskScheduler::global();
+
+	// Samples are tested many times over, so they are converted and downscaled only once
+	std::vector<cv::Mat> samples(images.size());
+	scheduler.parallel_for(0, images.size(), [&](size_t i) {
+		cv::Mat gray_img;
+		if (images.at(i).channels() == 1)
+			gray_img = images.at(i);
+		else
+			cv::cvtColor(images.at(i), gray_img, cv::COLOR_BGR2GRAY);
+		const double scale = 1280.0 / std::max(gray_img.cols, gray_img.rows);
+		if (scale < 1.0)
+			cv::resize(gray_img, samples.at(i), cv::Size(), scale, scale, cv::INTER_AREA);
+		else
+			samples.at(i) = gray_img;
+	});
+
+	// Chessboard detection does not care about orientation, so only landscape grids are tried.
+	// Larger grids go first since a sub-grid of the real pattern can also detect
+	std::vector<cv::Size> hypotheses;
+	for (int w = std::max(min_size.width, 2); w <= max_size.width; ++w) {
+		for (int h = std::max(min_size.height, 2); h <= std::min(w, max_size.height); ++h)
+			hypotheses.push_back(cv::Size(w, h));
+	}
+	std::stable_sort(hypotheses.begin(), hypotheses.end(), [](auto& a, auto& b) { return a.area() > b.area(); });
+	if (hypotheses.empty())
+		return cv::Size();
+
+	const int required_hits = std::max(1, std::min(min_hits, static_cast<int>(samples.size())));
+	const int total = static_cast<int>(hypotheses.size());
+	std::atomic<size_t> next_hypothesis{ 0 };
+	std::atomic<int> tested{ 0 };
+	std::atomic<int> best_area{ 0 };
+	std::atomic<bool> canceled{ false };
+	std::mutex best_lock;
+	cv::Size best;
+
+	// Lanes pull hypotheses strictly in order, so everything smaller than the first match is skipped
+	const size_t lanes = std::min<size_t>(scheduler.num_threads(), hypotheses.size());
+	scheduler.parallel_for(0, lanes, [&](size_t) {
+		std::vector<cv::Point2f> corners;
+		while (!canceled.load()) {
+			const size_t idx = next_hypothesis.fetch_add(1);
+			if (idx >= hypotheses.size())
+				return;
+			const cv::Size& size = hypotheses.at(idx);
+			if (size.area() <= best_area.load())
+				return;
+			int hits = 0;
+			for (size_t s = 0; s < samples.size(); ++s) {
+				if (size.area() <= best_area.load() || canceled.load())
+					break;
+				if (hits + static_cast<int>(samples.size() - s) < required_hits)
+					break;
+				if (cv::findChessboardCorners(samples.at(s), size, corners,
+					cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE | cv::CALIB_CB_FAST_CHECK))
+					++hits;
+				if (hits >= required_hits) {
+					std::lock_guard<std::mutex> guard(best_lock);
+					if (size.area() > best_area.load()) {
+						best_area.store(size.area());
+						best = size;
+					}
+					break;
+				}
+			}
+			const int done = ++tested;
+			if (progress && !progress(done, total))
+				canceled.store(true);
+		}
+	});
+	if (canceled.load())
+		return cv::Size();
+	// Keep the orientation the board was entered in, the detected grid is only known up to a transpose
+	if (best.width == preferred.height && best.height == preferred.width)
+		return preferred;
+	return best;
+}
+
 const double get_combined_area(const std::vector<ChessboardCorners>& corners)
 {
 	poly_set boards;
@@ -165,7 +328,7 @@ const double get_combined_area(const std::vector<ChessboardCorners>& corners)
 	return bg::area(boards);
 }
 
-const std::vector<ChessboardCorners> find_optimal_corners(const std::vector<ChessboardCorners>& orig_corners, const int num_selections)
+const std::vector<ChessboardCorners> find_optimal_corners(const std::vector<ChessboardCorners>& orig_corners, const int num_selections, const SolveProgress& progress)
 {
 	std::vector<ChessboardCorners> good_corners;
 	std::copy_if(orig_corners.begin(), orig_corners.end(), std::back_inserter(good_corners), [](auto& c) {return c.valid; });
@@ -173,26 +336,25 @@ const std::vector<ChessboardCorners> find_optimal_corners(const std::vector<Ches
 		return std::vector<ChessboardCorners>();
 	if (good_corners.size() <= num_selections)
 		return good_corners;
-	std::vector<size_t> good_idx(good_corners.size());
-	std::iota(good_idx.begin(), good_idx.end(), 0);
 	std::set<size_t> chosen_idx;
 	std::vector<ChessboardCorners> chosen_corners;
-	std::mutex lock;
+	// Each candidate writes only its own slot, so scoring needs no locking
+	std::vector<double> scores(good_corners.size());
 	for (int i = 0; i < num_selections; ++i) {
-		std::vector<std::pair<size_t, double>> scores;
-		std::for_each(std::execution::par_unseq, good_idx.begin(), good_idx.end(), [&](size_t i) {
-			if (chosen_idx.find(i) != chosen_idx.end())
+		TaskScheduler::global().parallel_for(0, good_corners.size(), [&](size_t j) {
+			if (chosen_idx.find(j) != chosen_idx.end()) {
+				scores.at(j) = -1.0;
 				return;
-			auto& c = good_corners.at(i);
+			}
 			auto corners_copy = chosen_corners;
-			corners_copy.push_back(c);
-			auto score = get_combined_area(corners_copy);
-			std::lock_guard<std::mutex> guard(lock);
-			scores.push_back(std::pair<size_t, double>(i, score));
+			corners_copy.push_back(good_corners.at(j));
+			scores.at(j) = get_combined_area(corners_copy);
 		});
-		std::sort(scores.begin(), scores.end(), [](auto& a, auto& b) {return a.second > b.second; });
-		chosen_idx.insert(scores.front().first);
-		chosen_corners.push_back(good_corners.at(scores.front().first));
+		const size_t best = static_cast<size_t>(std::distance(scores.begin(), std::max_element(scores.begin(), scores.end())));
+		chosen_idx.insert(best);
+		chosen_corners.push_back(good_corners.at(best));
+		if (progress && !progress(i + 1, num_selections))
+			return std::vector<ChessboardCorners>();
 	}
 	return chosen_corners;
 }
@@ -203,7 +365,8 @@ const CalibrationResult calibrate_camera(const ChessboardCorners& corners) {
 	return calibrate_camera(corners_corners, -1);
 }
 
-const CalibrationResult calibrate_camera(const std::vector<ChessboardCorners>& corners, const int num_selections) {
+const CalibrationResult calibrate_camera(const std::vector<ChessboardCorners>& corners, const int num_selections, const SolveProgress& progress,
+	const CalibrationSolver solver, const CalibrationResult* warm_start) {
 	CalibrationResult result;
 	if (corners.empty())
 		return result;
@@ -220,31 +383,150 @@ const CalibrationResult calibrate_camera(const std::vector<ChessboardCorners>& c
 	}
 	if (good_corners.empty())
 		return result;
-	if (num_selections > 0)
-		good_corners = find_optimal_corners(good_corners, num_selections);
+	if (num_selections > 0) {
+		if (progress && !progress(0, num_selections))
+			return result;
+		good_corners = find_optimal_corners(good_corners, num_selections, progress);
+		if (good_corners.empty())
+			return result;
+	}
 	result.c_corners = good_corners;
 	result.src_img_size = img_size;
-	std::vector<std::vector<cv::Point2f>> imgp;
-	std::vector<std::vector<cv::Point3f>> objp;
-	for (auto& c : good_corners) {
-		imgp.push_back(c.img_corners);
-		objp.push_back(c.obj_corners);
+	std::vector<ViewPose> poses;
+	if (solver == CalibrationSolver::bundle) {
+		BundleResult seed;
+		if (warm_start && warm_start->success && warm_start->src_img_size == img_size) {
+			seed.cam_Kk = warm_start->cam_Kk;
+			seed.success = true;
+		}
+		auto bundle = solve_bundle(good_corners, img_size, seed.success ? &seed : nullptr);
+		if (!bundle.success)
+			return result;
+		result.cam_Kk = bundle.cam_Kk;
+		poses = bundle.poses;
 	}
-	std::vector<float> dist_coeffs;
-	std::vector<cv::Mat> rvecs, tvecs;
-	cv::calibrateCamera(objp, imgp, img_size, result.cam_Kk.K, dist_coeffs, rvecs, tvecs);
-	result.cam_Kk.k(0) = dist_coeffs.at(0);
-	result.cam_Kk.k(1) = dist_coeffs.at(1);
-	result.cam_Kk.k(2) = dist_coeffs.at(4);
-	std::vector<double> singular_error(imgp.size());
-	std::vector<size_t> singular_idx(imgp.size());
-	std::iota(singular_idx.begin(), singular_idx.end(), 0);
-	std::for_each(std::execution::par_unseq, singular_idx.begin(), singular_idx.end(), [&](size_t i) {
-		std::vector<cv::Point2f> reproj_points;
-		cv::projectPoints(objp.at(i), rvecs.at(i), tvecs.at(i), result.cam_Kk.K, dist_coeffs, reproj_points);
-		singular_error.at(i) = cv::norm(imgp.at(i), reproj_points, cv::NORM_L2) / imgp.at(i).size();
-		});
-	result.reproj_error = std::accumulate(singular_error.begin(), singular_error.end(), 0.0) / singular_error.size();
+	else {
+		std::vector<std::vector<cv::Point2f>> imgp;
+		std::vector<std::vector<cv::Point3f>> objp;
+		for (auto& c : good_corners) {
+			imgp.push_back(c.img_corners);
+			objp.push_back(c.obj_corners);
+		}
+		std::vector<float> dist_coeffs;
+		std::vector<cv::Mat> rvecs, tvecs;
+		cv::calibrateCamera(objp, imgp, img_size, result.cam_Kk.K, dist_coeffs, rvecs, tvecs);
+		result.cam_Kk.k(0) = dist_coeffs.at(0);
+		result.cam_Kk.k(1) = dist_coeffs.at(1);
+		result.cam_Kk.k(2) = dist_coeffs.at(4);
+		for (size_t i = 0; i < rvecs.size(); ++i)
+			poses.push_back(ViewPose{ cv::Vec3d(rvecs.at(i)), cv::Vec3d(tvecs.at(i)) });
+	}
+	// Errors are measured with the exported radial model, without the tangential terms
+	ReprojectionErrors errors;
+	reprojection_errors(result.cam_Kk, good_corners, poses, errors);
+	result.reproj_error = errors.mean_view_error();
+	result.success = true;
+	return result;
+}
+
+const ParameterInterval ParameterInterval::scaled(const double factor) const
+{
+	ParameterInterval out;
+	out.std_dev = std_dev * std::abs(factor);
+	out.lower = std::min(lower * factor, upper * factor);
+	out.upper = std::max(lower * factor, upper * factor);
+	return out;
+}
+
+static const ParameterInterval percentile_interval(std::vector<double> values, const double confidence)
+{
+	ParameterInterval out;
+	if (values.size() < 2)
+		return out;
+	const double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+	double var = 0.0;
+	for (auto v : values)
+		var += (v - mean) * (v - mean);
+	out.std_dev = std::sqrt(var / (values.size() - 1));
+	std::sort(values.begin(), values.end());
+	auto quantile = [&](double q) {
+		const double pos = q * (values.size() - 1);
+		const size_t lo = static_cast<size_t>(std::floor(pos));
+		const size_t hi = std::min(lo + 1, values.size() - 1);
+		return values.at(lo) + (pos - lo) * (values.at(hi) - values.at(lo));
+	};
+	const double tail = (1.0 - confidence) / 2;
+	out.lower = quantile(tail);
+	out.upper = quantile(1.0 - tail);
+	return out;
+}
+
+const BootstrapResult bootstrap_calibration(const std::vector<ChessboardCorners>& corners, const int num_selections,
+	const int max_replicates, const double time_budget_s, const double confidence, const SolveProgress& progress,
+	const CalibrationSolver solver)
+{
+	BootstrapResult result;
+	result.confidence = confidence;
+	std::vector<ChessboardCorners> good_corners;
+	std::copy_if(corners.begin(), corners.end(), std::back_inserter(good_corners), [](auto& c) { return c.valid; });
+	if (good_corners.size() < 2 || max_replicates < 2)
+		return result;
+
+	// Each replicate resamples the detections with replacement and reruns the full pipeline,
+	// view selection included, so the spread reflects what an actual solve would produce
+	using Clock = std::chrono::steady_clock;
+	const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(time_budget_s));
+	std::vector<std::optional<CalibrationResult>> replicates(static_cast<size_t>(max_replicates));
+	std::vector<double> coverages(replicates.size(), 0.0);
+	std::atomic<int> done{ 0 };
+	std::atomic<bool> canceled{ false };
+	// View selection checks in after every pick, so a replicate running into the deadline or a
+	// cancel stops there instead of finishing its full solve
+	const SolveProgress in_budget = [&](const int, const int) { return !canceled.load() && Clock::now() <= deadline; };
+	TaskScheduler::global().parallel_for(0, replicates.size(), [&](size_t r) {
+		if (!in_budget(0, 0))
+			return;
+		std::mt19937 rng(static_cast<unsigned int>(r + 1));
+		std::uniform_int_distribution<size_t> pick(0, good_corners.size() - 1);
+		std::vector<ChessboardCorners> sample;
+		sample.reserve(good_corners.size());
+		for (size_t i = 0; i < good_corners.size(); ++i)
+			sample.push_back(good_corners.at(pick(rng)));
+		auto solve = calibrate_camera(sample, num_selections, in_budget, solver);
+		if (solve.success) {
+			// Same measure as the solution coverage shown for the actual solve
+			coverages.at(r) = get_combined_area(solve.c_corners) / solve.src_img_size.area() * 100;
+			replicates.at(r) = solve;
+		}
+		if (progress && !progress(++done, max_replicates))
+			canceled.store(true);
+	});
+	if (canceled.load())
+		return result;
+
+	std::vector<double> avg_err, sol_cov, norm_fx, h_fov, k1, k2, k3;
+	for (size_t i = 0; i < replicates.size(); ++i) {
+		auto& r = replicates.at(i);
+		if (!r)
+			continue;
+		avg_err.push_back(r->reproj_error);
+		sol_cov.push_back(coverages.at(i));
+		norm_fx.push_back(r->h_ratio());
+		h_fov.push_back(r->h_fov());
+		k1.push_back(r->cam_Kk.k(0));
+		k2.push_back(r->cam_Kk.k(1));
+		k3.push_back(r->cam_Kk.k(2));
+	}
+	result.replicates = static_cast<int>(norm_fx.size());
+	if (result.replicates < 2)
+		return result;
+	result.avg_err = percentile_interval(avg_err, confidence);
+	result.sol_cov = percentile_interval(sol_cov, confidence);
+	result.norm_fx = percentile_interval(norm_fx, confidence);
+	result.h_fov = percentile_interval(h_fov, confidence);
+	result.k1 = percentile_interval(k1, confidence);
+	result.k2 = percentile_interval(k2, confidence);
+	result.k3 = percentile_interval(k3, confidence);
 	result.success = true;
 	return result;
 }
@@ -2,11 +2,25 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/calib3d.hpp>
+#include <functional>
+
+// Reports (completed rounds, total rounds) of a long running solve. Returning false cancels it.
+using SolveProgress = std::function<bool(const int, const int)>;
+
+// opencv runs cv::calibrateCamera and drops its tangential terms, bundle fits the exported model directly
+enum class CalibrationSolver {
+    opencv,
+    bundle
+};
 
 struct Kk {
     cv::Matx33d K = cv::Matx33d::eye();
     cv::Matx13d k = cv::Matx13d::zeros();
     const std::vector<float> dist_vector() const;
+    // Radial model on normalized image coordinates. undistort_point solves the inverse with
+    // Newton's method starting from guess, and returns false if it did not converge
+    const cv::Point2d distort_point(const cv::Point2d& p) const;
+    bool undistort_point(const cv::Point2d& p, const cv::Point2d& guess, cv::Point2d& out, const int max_iter = 20, const double eps = 1e-9) const;
 };
 
 struct ChessboardCorners {
@@ -27,22 +41,64 @@ struct CalibrationResult {
     std::vector<ChessboardCorners> c_corners;
     cv::Size src_img_size;
     void undistort(cv::Mat& image) const;
+    void undistort_maps(const cv::Size& size, cv::Mat& map_a, cv::Mat& map_b) const;
+    void undistort_maps(const cv::Size& src_size, const cv::Size& dst_size, cv::Mat& map_a, cv::Mat& map_b) const;
+    const cv::Matx33d scaled_K(const cv::Size& size) const;
+    // Maps a pixel of the undistorted image at size back to the distorted image
+    const cv::Point2f distort_pixel(const cv::Point2f& p, const cv::Size& size) const;
     const double h_ratio() const;
     const double h_fov() const;
     const double focal_length(const double sensor_width = 36) const;
     bool success = false;
 };
 
+struct ParameterInterval {
+    double std_dev = 0.0;
+    double lower = 0.0;
+    double upper = 0.0;
+    const ParameterInterval scaled(const double factor) const;
+};
+
+struct BootstrapResult {
+    int replicates = 0;
+    double confidence = 0.95;
+    ParameterInterval avg_err;
+    ParameterInterval sol_cov;
+    ParameterInterval norm_fx;
+    ParameterInterval h_fov;
+    ParameterInterval k1;
+    ParameterInterval k2;
+    ParameterInterval k3;
+    bool success = false;
+};
+
 const ChessboardCorners get_corners(const cv::Mat& image, const int board_width, const int board_height);
 
 const std::vector<ChessboardCorners> get_corners(const std::vector<cv::Mat>& images, const int board_width, const int board_height);
 
+const cv::Size infer_board_size(const std::vector<cv::Mat>& images,
+	const cv::Size& min_size = cv::Size(3, 3),
+	const cv::Size& max_size = cv::Size(20, 20),
+	const int min_hits = 2,
+	const SolveProgress& progress = nullptr,
+	const cv::Size& preferred = cv::Size());
+
 const double get_combined_area(const std::vector<ChessboardCorners>& corners);
 
-const std::vector<ChessboardCorners> find_optimal_corners(const std::vector<ChessboardCorners>& orig_corners, const int num_selections);
+const std::vector<ChessboardCorners> find_optimal_corners(const std::vector<ChessboardCorners>& orig_corners, const int num_selections, const SolveProgress& progress = nullptr);
 
 const CalibrationResult calibrate_camera(const ChessboardCorners& corners);
 
-const CalibrationResult calibrate_camera(const std::vector<ChessboardCorners>& corners, const int num_selections = 10);
+// warm_start seeds the intrinsics of the bundle solver and is ignored by the OpenCV solver
+const CalibrationResult calibrate_camera(const std::vector<ChessboardCorners>& corners, const int num_selections = 10, const SolveProgress& progress = nullptr,
+    const CalibrationSolver solver = CalibrationSolver::opencv, const CalibrationResult* warm_start = nullptr);
+
+const BootstrapResult bootstrap_calibration(const std::vector<ChessboardCorners>& corners,
+    const int num_selections = 10,
+    const int max_replicates = 200,
+    const double time_budget_s = 30.0,
+    const double confidence = 0.95,
+    const SolveProgress& progress = nullptr,
+    const CalibrationSolver solver = CalibrationSolver::opencv);
 
 const cv::Mat generate_board_image(const int board_width = 10, const int board_height = 10);
@@ -0,0 +1,126 @@
+#include "convergence.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+
+namespace {
+	// Fewer views leave the distortion terms too loose to judge convergence
+	constexpr int min_solve_views = 5;
+}
+
+const bool ConvergenceGoals::enabled() const
+{
+	return coverage > 0.0 || needs_solves();
+}
+
+const bool ConvergenceGoals::needs_solves() const
+{
+	return focal_change > 0.0 || k1_change > 0.0;
+}
+
+ConvergenceMonitor::ConvergenceMonitor(const ConvergenceGoals& goals, const cv::Size& img_size)
+	: goals(goals)
+	, img_size(img_size)
+{
+}
+
+ConvergenceMonitor::~ConvergenceMonitor()
+{
+	if (solve_thread.joinable())
+		solve_thread.join();
+}
+
+void ConvergenceMonitor::add_detection(const double coverage)
+{
+	++detections;
+	last_coverage = coverage;
+}
+
+const bool ConvergenceMonitor::solve_due() const
+{
+	return goals.needs_solves() && !solving && detections >= min_solve_views
+		&& detections - last_solve_detections >= std::max(1, goals.solve_interval);
+}
+
+void ConvergenceMonitor::start_solve(const std::vector<ChessboardCorners>& views)
+{
+	if (solving)
+		return;
+	last_solve_detections = detections;
+	std::vector<ChessboardCorners> subset;
+	const size_t count = std::min(views.size(), static_cast<size_t>(std::max(min_solve_views, goals.max_solve_views)));
+	for (size_t i = 0; i < count; ++i)
+		subset.push_back(views.at(i * views.size() / count));
+
+	// A loose tolerance is enough to see whether the intrinsics still move
+	BundleOptions options;
+	options.max_iter = 30;
+	options.tolerance = 1e-6;
+	solving = true;
+	solve_done.store(false);
+	solve_thread = std::thread([this, subset = std::move(subset), warm = latest, options]() {
+		BundleResult next;
+		try {
+			next = solve_bundle(subset, img_size, warm.success ? &warm : nullptr, options);
+		}
+		catch (const std::exception&) {
+			// Counts as a failed check, the next one starts over
+		}
+		next.poses.clear();
+		solve_result = std::move(next);
+		solve_done.store(true);
+	});
+}
+
+bool ConvergenceMonitor::collect()
+{
+	if (!solving || !solve_done.load())
+		return false;
+	solve_thread.join();
+	solving = false;
+	BundleResult next = std::move(solve_result);
+	if (!next.success)
+		return false;
+	previous = latest;
+	latest = std::move(next);
+	++num_solves;
+	return true;
+}
+
+const bool ConvergenceMonitor::converged() const
+{
+	if (!goals.enabled())
+		return false;
+	if (goals.coverage > 0.0 && last_coverage < goals.coverage)
+		return false;
+	if (goals.focal_change > 0.0 && !(focal_change() < goals.focal_change))
+		return false;
+	if (goals.k1_change > 0.0 && !(k1_change() < goals.k1_change))
+		return false;
+	return true;
+}
+
+const int ConvergenceMonitor::solves() const
+{
+	return num_solves;
+}
+
+const double ConvergenceMonitor::coverage() const
+{
+	return last_coverage;
+}
+
+const double ConvergenceMonitor::focal_change() const
+{
+	if (num_solves < 2)
+		return std::numeric_limits<double>::infinity();
+	return std::abs(latest.cam_Kk.K(0, 0) - previous.cam_Kk.K(0, 0)) / previous.cam_Kk.K(0, 0);
+}
+
+const double ConvergenceMonitor::k1_change() const
+{
+	if (num_solves < 2)
+		return std::numeric_limits<double>::infinity();
+	return std::abs(latest.cam_Kk.k(0) - previous.cam_Kk.k(0));
+}
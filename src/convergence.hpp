@@ -0,0 +1,67 @@
+#pragma once
+
+#include "bundle.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Targets that end an auto detect scan early. A zero target is disabled, and the scan
+// stops once every enabled target is met
+struct ConvergenceGoals {
+	// Fraction of the frame covered by stored boards
+	double coverage = 0.0;
+	// Relative change of fx between two consecutive checking solves
+	double focal_change = 0.0;
+	// Absolute change of K1 between two consecutive checking solves
+	double k1_change = 0.0;
+	// New detections between two checking solves
+	int solve_interval = 10;
+	// Views handed to a checking solve, spread evenly over the stored boards
+	int max_solve_views = 60;
+
+	const bool enabled() const;
+	const bool needs_solves() const;
+};
+
+// Checking solves run on a thread of their own, so the thread driving the scan never waits on them.
+// Scheduler workers can all be busy scanning, the solve then works through its parallel loops
+// itself. Only one runs at a time, its result counts once collect() has picked it up
+class ConvergenceMonitor {
+public:
+	ConvergenceMonitor(const ConvergenceGoals& goals, const cv::Size& img_size);
+	// Waits for a solve that is still running
+	~ConvergenceMonitor();
+	ConvergenceMonitor(const ConvergenceMonitor&) = delete;
+	ConvergenceMonitor& operator=(const ConvergenceMonitor&) = delete;
+
+	// Counts a stored detection and records the coverage after it
+	void add_detection(const double coverage);
+	const bool solve_due() const;
+	// Starts a quick bundle solve on a subset of views, warm started from the previous check
+	void start_solve(const std::vector<ChessboardCorners>& views);
+	// Takes in a finished solve, true if there was one
+	bool collect();
+	const bool converged() const;
+
+	const int solves() const;
+	const double coverage() const;
+	// Changes between the last two solves, infinite before the second one
+	const double focal_change() const;
+	const double k1_change() const;
+
+private:
+	ConvergenceGoals goals;
+	cv::Size img_size;
+	int detections = 0;
+	int last_solve_detections = 0;
+	double last_coverage = 0.0;
+	BundleResult previous;
+	BundleResult latest;
+	int num_solves = 0;
+
+	std::thread solve_thread;
+	bool solving = false;
+	// Set by the solve thread once solve_result is written
+	std::atomic<bool> solve_done{ false };
+	BundleResult solve_result;
+};
@@ -0,0 +1,169 @@
+#include "coverage.hpp"
+#include <algorithm>
+#include <map>
+#include <boost/geometry.hpp>
+#include <boost/geometry/geometries/box.hpp>
+#include <boost/geometry/geometries/geometries.hpp>
+#include <boost/geometry/geometries/point_xy.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+using poly_point = bg::model::d2::point_xy<double>;
+using polygon = bg::model::polygon<poly_point>;
+using poly_box = bg::model::box<poly_point>;
+using tree_value = std::pair<poly_box, int>;
+
+namespace {
+	// Longer frame side in grid cells
+	constexpr int grid_cells = 128;
+}
+
+struct CoverageIndex::Index {
+	bgi::rtree<tree_value, bgi::rstar<16>> tree;
+	std::map<int, std::pair<poly_box, polygon>> outlines;
+	std::map<int, std::vector<cv::Point>> cells;
+	cv::Mat counts;
+	cv::Size frame_size;
+	double cell_px = 1.0;
+
+	const std::vector<cv::Point> grid_outline(const polygon& poly) const {
+		std::vector<cv::Point> out;
+		for (auto& p : poly.outer())
+			out.push_back(cv::Point(static_cast<int>(std::lround(p.x() / cell_px)), static_cast<int>(std::lround(p.y() / cell_px))));
+		return out;
+	}
+
+	// Outlines already stored are rasterized again at the new resolution
+	void reset_grid(const cv::Size& size) {
+		frame_size = size;
+		cell_px = std::max(1.0, static_cast<double>(std::max(size.width, size.height)) / grid_cells);
+		counts = cv::Mat::zeros(std::max(1, static_cast<int>(std::ceil(size.height / cell_px))),
+			std::max(1, static_cast<int>(std::ceil(size.width / cell_px))), CV_32SC1);
+		cells.clear();
+		for (auto& o : outlines) {
+			cells[o.first] = grid_outline(o.second.second);
+			add_cells(cells[o.first], 1);
+		}
+	}
+
+	// Rasterizes only the outline's bounding rectangle of the grid
+	void add_cells(const std::vector<cv::Point>& poly, const int delta) {
+		if (poly.empty())
+			return;
+		const cv::Rect bounds = cv::boundingRect(poly) & cv::Rect(0, 0, counts.cols, counts.rows);
+		if (bounds.empty())
+			return;
+		cv::Mat mask = cv::Mat::zeros(bounds.size(), CV_8UC1);
+		std::vector<std::vector<cv::Point>> shifted(1);
+		for (auto& p : poly)
+			shifted.at(0).push_back(p - bounds.tl());
+		cv::fillPoly(mask, shifted, cv::Scalar(1));
+		cv::Mat region = counts(bounds);
+		for (int y = 0; y < mask.rows; ++y) {
+			const uchar* m = mask.ptr<uchar>(y);
+			int* c = region.ptr<int>(y);
+			for (int x = 0; x < mask.cols; ++x)
+				c[x] += m[x] * delta;
+		}
+	}
+};
+
+CoverageIndex::CoverageIndex()
+	: index(std::make_unique<Index>())
+{
+}
+
+CoverageIndex::~CoverageIndex() = default;
+
+void CoverageIndex::insert(const int frame, const ChessboardCorners& corners)
+{
+	auto outer = corners.outer_corners();
+	if (outer.size() < 4)
+		return;
+	auto existing = index->outlines.find(frame);
+	if (existing != index->outlines.end()) {
+		index->tree.remove(tree_value(existing->second.first, frame));
+		index->add_cells(index->cells[frame], -1);
+		index->outlines.erase(existing);
+		index->cells.erase(frame);
+	}
+	if (index->counts.empty() || index->frame_size != corners.src_img_size)
+		index->reset_grid(corners.src_img_size);
+
+	polygon poly;
+	for (auto& p : outer)
+		bg::append(poly.outer(), poly_point(p.x, p.y));
+	bg::append(poly.outer(), poly_point(outer.at(0).x, outer.at(0).y));
+	bg::correct(poly);
+	const poly_box box = bg::return_envelope<poly_box>(poly);
+	index->tree.insert(tree_value(box, frame));
+	index->outlines[frame] = std::make_pair(box, poly);
+	index->cells[frame] = index->grid_outline(poly);
+	index->add_cells(index->cells[frame], 1);
+}
+
+void CoverageIndex::clear()
+{
+	index = std::make_unique<Index>();
+}
+
+const size_t CoverageIndex::size() const
+{
+	return index->outlines.size();
+}
+
+const std::vector<int> CoverageIndex::frames_at(const cv::Point2f& p) const
+{
+	const poly_point pt(p.x, p.y);
+	std::vector<tree_value> candidates;
+	index->tree.query(bgi::intersects(pt), std::back_inserter(candidates));
+	std::vector<int> out;
+	for (auto& c : candidates) {
+		if (bg::covered_by(pt, index->outlines.at(c.second).second))
+			out.push_back(c.second);
+	}
+	std::sort(out.begin(), out.end());
+	return out;
+}
+
+const std::vector<int> CoverageIndex::frames_in(const cv::Rect2f& region) const
+{
+	const poly_box query(poly_point(region.x, region.y), poly_point(region.x + region.width, region.y + region.height));
+	std::vector<tree_value> candidates;
+	index->tree.query(bgi::intersects(query), std::back_inserter(candidates));
+	std::vector<int> out;
+	for (auto& c : candidates) {
+		if (bg::intersects(query, index->outlines.at(c.second).second))
+			out.push_back(c.second);
+	}
+	std::sort(out.begin(), out.end());
+	return out;
+}
+
+const int CoverageIndex::nearest_frame_at(const cv::Point2f& p, const int frame) const
+{
+	int best = 0;
+	for (int f : frames_at(p)) {
+		if (f != frame && (best == 0 || std::abs(f - frame) < std::abs(best - frame)))
+			best = f;
+	}
+	return best;
+}
+
+const cv::Mat CoverageIndex::gap_mask() const
+{
+	if (index->counts.empty())
+		return cv::Mat();
+	cv::Mat mask;
+	cv::compare(index->counts, 0, mask, cv::CMP_EQ);
+	return mask;
+}
+
+const double CoverageIndex::covered_fraction() const
+{
+	if (index->counts.empty())
+		return 0.0;
+	return static_cast<double>(cv::countNonZero(index->counts)) / index->counts.total();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "calibration.hpp"
+#include <memory>
+#include <vector>
+
+// Spatial index over the board outlines of stored detections, kept up to date on every insert.
+// Point and region queries go through an R-tree of outline bounding boxes, and a coarse grid
+// of per-cell detection counts answers where the gaps are without touching the polygons
+class CoverageIndex {
+public:
+	CoverageIndex();
+	~CoverageIndex();
+	CoverageIndex(const CoverageIndex&) = delete;
+	CoverageIndex& operator=(const CoverageIndex&) = delete;
+
+	// Replaces any detection already stored for frame
+	void insert(const int frame, const ChessboardCorners& corners);
+	void clear();
+	const size_t size() const;
+
+	// Frames whose board outline contains p, in source pixels
+	const std::vector<int> frames_at(const cv::Point2f& p) const;
+	const std::vector<int> frames_in(const cv::Rect2f& region) const;
+	// Covering frame closest to frame other than frame itself, 0 if nothing covers p
+	const int nearest_frame_at(const cv::Point2f& p, const int frame) const;
+
+	// CV_8UC1 at grid resolution, 255 where no detection covers the cell. Empty before the first insert
+	const cv::Mat gap_mask() const;
+	const double covered_fraction() const;
+
+private:
+	struct Index;
+	std::unique_ptr<Index> index;
+};
@@ -0,0 +1,582 @@
+#include "distributed.hpp"
+#include "scheduler.hpp"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Wire format: every message is a big endian quint32 payload length followed by a QDataStream payload.
+//
+// Request:  magic, version, job id, job kind, board width, board height, then either
+//           (video path, first frame, last frame, frame step) for video jobs, or
+//           (frame count, count x (frame index, PNG encoded luma)) for frame jobs
+// Response: magic, version, job id, status, error message, detection count, count x (frame index, corners)
+//
+// Frame indices are 1-based positions, the same keys window::frame_corners uses
+
+namespace {
+	constexpr quint32 protocol_magic = 0x42434344;
+	constexpr quint16 protocol_version = 1;
+	constexpr quint32 max_message_size = 1u << 30;
+	constexpr int connect_timeout_ms = 5000;
+	// A socket may stay silent this long. Replies only stall while a worker runs detection, so
+	// shards are capped at max_shard_analysed_frames to finish well inside it
+	constexpr int io_idle_timeout_ms = 10 * 60 * 1000;
+	// Also bounds frame jobs, which carry a few MB of PNG per frame, below max_message_size
+	constexpr int max_shard_analysed_frames = 120;
+	// findChessboardCorners needs at least 3 inner corners per side
+	constexpr qint32 min_board_side = 3;
+	constexpr qint32 max_board_side = 64;
+	// A client keeps one connection per worker address, so a handful covers several clients at once
+	constexpr int max_worker_connections = 8;
+
+	enum class JobKind : quint8 {
+		video = 0,
+		frames = 1
+	};
+
+	enum class JobStatus : quint8 {
+		ok = 0,
+		failed = 1
+	};
+
+	struct Shard {
+		int first = 0;
+		int last = 0;
+		int attempts = 0;
+	};
+
+	using Detections = std::vector<std::pair<int, ChessboardCorners>>;
+
+	void write_corners(QDataStream& ds, const ChessboardCorners& c)
+	{
+		ds << qint32(c.board_size.width) << qint32(c.board_size.height)
+			<< qint32(c.src_img_size.width) << qint32(c.src_img_size.height)
+			<< quint8(c.valid ? 1 : 0) << quint32(c.img_corners.size());
+		for (auto& p : c.img_corners)
+			ds << p.x << p.y;
+	}
+
+	bool read_corners(QDataStream& ds, ChessboardCorners& c)
+	{
+		qint32 bw, bh, sw, sh;
+		quint8 valid;
+		quint32 count;
+		ds >> bw >> bh >> sw >> sh >> valid >> count;
+		if (ds.status() != QDataStream::Ok || bw < 0 || bh < 0 || bw > max_board_side || bh > max_board_side
+			|| count != static_cast<quint32>(bw) * static_cast<quint32>(bh))
+			return false;
+		c = ChessboardCorners(bw, bh);
+		c.src_img_size = cv::Size(sw, sh);
+		c.valid = valid != 0;
+		for (auto& p : c.img_corners)
+			ds >> p.x >> p.y;
+		return ds.status() == QDataStream::Ok;
+	}
+
+	QDataStream& setup_stream(QDataStream& ds)
+	{
+		ds.setVersion(QDataStream::Qt_6_0);
+		ds.setFloatingPointPrecision(QDataStream::SinglePrecision);
+		return ds;
+	}
+
+	bool wait_for_bytes(QTcpSocket& socket, const qint64 count, const std::function<bool()>& canceled)
+	{
+		// The timeout measures silence, so large payloads arriving slowly are not cut off
+		QElapsedTimer idle;
+		idle.start();
+		qint64 available = socket.bytesAvailable();
+		while (available < count) {
+			if ((canceled && canceled()) || idle.hasExpired(io_idle_timeout_ms) || socket.state() != QAbstractSocket::ConnectedState)
+				return false;
+			socket.waitForReadyRead(200);
+			if (socket.bytesAvailable() > available) {
+				available = socket.bytesAvailable();
+				idle.restart();
+			}
+		}
+		return true;
+	}
+
+	bool write_message(QTcpSocket& socket, const QByteArray& payload)
+	{
+		QByteArray header;
+		QDataStream ds(&header, QIODevice::WriteOnly);
+		ds << quint32(payload.size());
+		if (socket.write(header) != header.size() || socket.write(payload) != payload.size())
+			return false;
+		while (socket.bytesToWrite() > 0) {
+			if (!socket.waitForBytesWritten(io_idle_timeout_ms))
+				return false;
+		}
+		return true;
+	}
+
+	bool read_message(QTcpSocket& socket, QByteArray& payload, const std::function<bool()>& canceled = nullptr)
+	{
+		if (!wait_for_bytes(socket, 4, canceled))
+			return false;
+		QDataStream hs(socket.read(4));
+		quint32 size;
+		hs >> size;
+		if (size > max_message_size || !wait_for_bytes(socket, size, canceled))
+			return false;
+		payload = socket.read(size);
+		return payload.size() == static_cast<qsizetype>(size);
+	}
+
+	// Detection runs in batches so the scheduler always has a full set of frames to spread across cores
+	void detect_batch(std::vector<cv::Mat>& frames, std::vector<int>& positions, const cv::Size& board_size, Detections& out)
+	{
+		if (frames.empty())
+			return;
+		auto corners = get_corners(frames, board_size.width, board_size.height);
+		for (size_t i = 0; i < corners.size(); ++i) {
+			if (corners.at(i).valid)
+				out.emplace_back(positions.at(i), corners.at(i));
+		}
+		frames.clear();
+		positions.clear();
+	}
+
+	bool process_video_job(const std::string& path, const int first, const int last, const int step,
+		const cv::Size& board_size, Detections& out, std::string& error)
+	{
+		// Clients may only point at files on this machine. VideoCapture also opens URLs, devices and
+		// GStreamer pipelines, so anything that is not an existing regular file is refused up front
+		const QFileInfo info(QString::fromStdString(path));
+		if (!info.isAbsolute() || !info.isFile() || !info.isReadable()) {
+			error = "Not a readable local video file: \"" + path + "\"";
+			return false;
+		}
+		cv::VideoCapture cap(info.canonicalFilePath().toStdString(), cv::CAP_FFMPEG);
+		if (!cap.isOpened()) {
+			error = "Failed to open \"" + path + "\"";
+			return false;
+		}
+		if (first > 1 && !cap.set(cv::CAP_PROP_POS_FRAMES, first - 1)) {
+			error = "Failed to seek to frame " + std::to_string(first);
+			return false;
+		}
+		const size_t batch_size = std::max<size_t>(1, TaskScheduler::global().num_threads() * 2);
+		std::vector<cv::Mat> frames;
+		std::vector<int> positions;
+		for (int pos = first; pos <= last; ++pos) {
+			// Skipped frames are only demuxed and decoded, never converted. A frame that cannot be
+			// decoded fails the whole shard, so the client retries it instead of losing detections
+			if ((pos - first) % step != 0) {
+				if (!cap.grab()) {
+					error = "Failed to decode frame " + std::to_string(pos);
+					return false;
+				}
+				continue;
+			}
+			cv::Mat frame;
+			if (!cap.read(frame)) {
+				error = "Failed to decode frame " + std::to_string(pos);
+				return false;
+			}
+			cv::Mat gray;
+			cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+			frames.push_back(gray);
+			positions.push_back(pos);
+			if (frames.size() >= batch_size)
+				detect_batch(frames, positions, board_size, out);
+		}
+		detect_batch(frames, positions, board_size, out);
+		return true;
+	}
+
+	bool valid_board_size(const qint32 bw, const qint32 bh)
+	{
+		return bw >= min_board_side && bh >= min_board_side && bw <= max_board_side && bh <= max_board_side;
+	}
+
+	QByteArray handle_request(const QByteArray& request)
+	{
+		QDataStream in(request);
+		setup_stream(in);
+		quint32 magic;
+		quint16 version;
+		quint64 job_id = 0;
+		quint8 kind;
+		qint32 bw, bh;
+		in >> magic >> version >> job_id >> kind >> bw >> bh;
+
+		Detections detections;
+		std::string error;
+		bool ok = in.status() == QDataStream::Ok && magic == protocol_magic && version == protocol_version;
+		if (!ok)
+			error = "Malformed request";
+		else if (!valid_board_size(bw, bh)) {
+			ok = false;
+			error = "Unsupported board size " + std::to_string(bw) + "x" + std::to_string(bh);
+		}
+		const cv::Size board_size(bw, bh);
+		// Anything OpenCV throws fails this job only, an escaping exception would end the worker
+		try {
+			if (ok && static_cast<JobKind>(kind) == JobKind::video) {
+				QString path;
+				qint32 first, last, step;
+				in >> path >> first >> last >> step;
+				ok = in.status() == QDataStream::Ok && first >= 1 && last >= first && step > 0;
+				if (ok)
+					ok = process_video_job(path.toStdString(), first, last, step, board_size, detections, error);
+				else
+					error = "Malformed video job";
+			}
+			else if (ok && static_cast<JobKind>(kind) == JobKind::frames) {
+				qint32 count;
+				in >> count;
+				ok = in.status() == QDataStream::Ok && count >= 0 && count <= max_shard_analysed_frames;
+				std::vector<cv::Mat> frames;
+				std::vector<int> positions;
+				for (qint32 i = 0; ok && i < count; ++i) {
+					qint32 pos;
+					QByteArray encoded;
+					in >> pos >> encoded;
+					ok = in.status() == QDataStream::Ok && !encoded.isEmpty();
+					if (!ok)
+						break;
+					cv::Mat frame = cv::imdecode(cv::Mat(1, static_cast<int>(encoded.size()), CV_8UC1, encoded.data()), cv::IMREAD_GRAYSCALE);
+					ok = !frame.empty();
+					frames.push_back(frame);
+					positions.push_back(pos);
+				}
+				if (ok)
+					detect_batch(frames, positions, board_size, detections);
+				else
+					error = "Malformed frame job";
+			}
+			else if (ok) {
+				ok = false;
+				error = "Unknown job kind";
+			}
+		}
+		catch (const std::exception& e) {
+			ok = false;
+			error = std::string("Job failed: ") + e.what();
+			detections.clear();
+		}
+
+		QByteArray response;
+		QDataStream out(&response, QIODevice::WriteOnly);
+		setup_stream(out);
+		out << protocol_magic << protocol_version << job_id << quint8(ok ? JobStatus::ok : JobStatus::failed)
+			<< QString::fromStdString(error) << quint32(ok ? detections.size() : 0);
+		if (ok) {
+			for (auto& d : detections) {
+				out << qint32(d.first);
+				write_corners(out, d.second);
+			}
+		}
+		return response;
+	}
+
+	// Each connection gets a thread from a bounded pool with a blocking socket, requests on it are
+	// served in order. Connections beyond the pool size are closed right away
+	class WorkerServer : public QTcpServer {
+	public:
+		WorkerServer() {
+			connections.setMaxThreadCount(max_worker_connections);
+		}
+		~WorkerServer() override {
+			close();
+			stopping.store(true);
+			connections.waitForDone();
+		}
+
+	protected:
+		void incomingConnection(qintptr descriptor) override {
+			const bool started = connections.tryStart([this, descriptor]() {
+				QTcpSocket socket;
+				if (!socket.setSocketDescriptor(descriptor))
+					return;
+				auto is_stopping = [this]() { return stopping.load(); };
+				QByteArray request;
+				while (read_message(socket, request, is_stopping)) {
+					if (!write_message(socket, handle_request(request)))
+						break;
+				}
+				socket.disconnectFromHost();
+			});
+			if (started)
+				return;
+			QTcpSocket socket;
+			if (socket.setSocketDescriptor(descriptor))
+				socket.abort();
+			std::cerr << "Refused connection, " << max_worker_connections << " connections are already open" << std::endl;
+		}
+
+	private:
+		QThreadPool connections;
+		std::atomic<bool> stopping{ false };
+	};
+
+	bool build_request(const quint64 job_id, const DistributedScan& scan, const Shard& shard, cv::VideoCapture* frame_source,
+		QByteArray& request, std::string& error)
+	{
+		request.clear();
+		QDataStream out(&request, QIODevice::WriteOnly);
+		setup_stream(out);
+		out << protocol_magic << protocol_version << job_id;
+		if (!frame_source) {
+			out << quint8(JobKind::video) << qint32(scan.board_size.width) << qint32(scan.board_size.height)
+				<< QString::fromStdString(scan.video_path) << qint32(shard.first) << qint32(shard.last) << qint32(scan.frame_step);
+			return true;
+		}
+
+		// Frame jobs carry lossless luma only, which is all detection needs. Like on the worker, a
+		// shard whose range cannot be read completely is failed rather than sent short
+		std::vector<std::pair<int, std::vector<uchar>>> encoded;
+		if (!frame_source->isOpened()) {
+			error = "Failed to open \"" + scan.video_path + "\"";
+			return false;
+		}
+		if (shard.first > 1 && !frame_source->set(cv::CAP_PROP_POS_FRAMES, shard.first - 1)) {
+			error = "Failed to seek to frame " + std::to_string(shard.first);
+			return false;
+		}
+		for (int pos = shard.first; pos <= shard.last; ++pos) {
+			if ((pos - shard.first) % scan.frame_step != 0) {
+				if (!frame_source->grab()) {
+					error = "Failed to decode frame " + std::to_string(pos);
+					return false;
+				}
+				continue;
+			}
+			cv::Mat frame, gray;
+			if (!frame_source->read(frame)) {
+				error = "Failed to decode frame " + std::to_string(pos);
+				return false;
+			}
+			cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+			encoded.emplace_back(pos, std::vector<uchar>());
+			cv::imencode(".png", gray, encoded.back().second, { cv::IMWRITE_PNG_COMPRESSION, 1 });
+		}
+		out << quint8(JobKind::frames) << qint32(scan.board_size.width) << qint32(scan.board_size.height) << qint32(encoded.size());
+		for (auto& e : encoded)
+			out << qint32(e.first) << QByteArray(reinterpret_cast<const char*>(e.second.data()), static_cast<qsizetype>(e.second.size()));
+		return true;
+	}
+
+	bool parse_response(const QByteArray& response, const quint64 job_id, Detections& out, std::string& error)
+	{
+		QDataStream in(response);
+		setup_stream(in);
+		quint32 magic;
+		quint16 version;
+		quint64 id;
+		quint8 status;
+		QString message;
+		quint32 count;
+		in >> magic >> version >> id >> status >> message >> count;
+		if (in.status() != QDataStream::Ok || magic != protocol_magic || version != protocol_version || id != job_id) {
+			error = "Malformed response";
+			return false;
+		}
+		if (static_cast<JobStatus>(status) != JobStatus::ok) {
+			error = message.toStdString();
+			return false;
+		}
+		for (quint32 i = 0; i < count; ++i) {
+			qint32 pos;
+			ChessboardCorners corners;
+			in >> pos;
+			if (!read_corners(in, corners)) {
+				error = "Malformed detection in response";
+				return false;
+			}
+			out.emplace_back(pos, corners);
+		}
+		return true;
+	}
+}
+
+const std::vector<WorkerAddress> parse_worker_addresses(const std::string& list)
+{
+	std::vector<WorkerAddress> out;
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ',')) {
+		item.erase(std::remove_if(item.begin(), item.end(), [](unsigned char c) { return std::isspace(c); }), item.end());
+		if (item.empty())
+			continue;
+		WorkerAddress address;
+		const auto colon = item.rfind(':');
+		if (colon == std::string::npos)
+			address.host = item;
+		else {
+			address.host = item.substr(0, colon);
+			address.port = std::atoi(item.substr(colon + 1).c_str());
+		}
+		if (!address.host.empty() && address.port > 0 && address.port < 65536)
+			out.push_back(address);
+	}
+	return out;
+}
+
+int run_detection_worker(const std::string& listen_address, const int port)
+{
+	WorkerServer server;
+	// Jobs are not authenticated, so exposing the worker to the network takes an explicit address
+	const QHostAddress address = listen_address.empty() ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(QString::fromStdString(listen_address));
+	if (address.isNull()) {
+		std::cerr << "Invalid listen address \"" << listen_address << "\"" << std::endl;
+		return 1;
+	}
+	if (!server.listen(address, static_cast<quint16>(port))) {
+		std::cerr << "Failed to listen on port " << port << ": " << server.errorString().toStdString() << std::endl;
+		return 1;
+	}
+	std::cout << "Detection worker listening on " << server.serverAddress().toString().toStdString()
+		<< ":" << server.serverPort() << " with " << TaskScheduler::global().num_threads() << " threads" << std::endl;
+	return QCoreApplication::exec();
+}
+
+const DistributedScanResult run_distributed_scan(const std::vector<WorkerAddress>& workers, const DistributedScan& scan,
+	const SolveProgress& progress)
+{
+	DistributedScanResult result;
+	if (workers.empty()) {
+		result.error = "No workers given";
+		return result;
+	}
+	if (scan.last_frame < scan.first_frame || scan.frame_step < 1) {
+		result.error = "Empty frame range";
+		return result;
+	}
+
+	// Shards start on the step grid, so the merged result matches a sequential scan
+	const int span = scan.last_frame - scan.first_frame + 1;
+	int shard_frames = scan.shard_frames;
+	if (shard_frames <= 0)
+		shard_frames = std::max(scan.frame_step, span / static_cast<int>(workers.size() * 4));
+	shard_frames = std::clamp(shard_frames / scan.frame_step, 1, max_shard_analysed_frames) * scan.frame_step;
+	std::deque<Shard> queue;
+	for (int first = scan.first_frame; first <= scan.last_frame; first += shard_frames)
+		queue.push_back(Shard{ first, std::min(scan.last_frame, first + shard_frames - 1), 0 });
+	result.shards = static_cast<int>(queue.size());
+
+	std::mutex lock;
+	int in_flight = 0;
+	int finished = 0;
+	int live_workers = static_cast<int>(workers.size());
+	std::atomic<bool> canceled{ false };
+	std::atomic<quint64> next_job{ 1 };
+	auto is_canceled = [&]() { return canceled.load(); };
+
+	auto worker_loop = [&](const WorkerAddress address) {
+		QTcpSocket socket;
+		std::unique_ptr<cv::VideoCapture> frame_source;
+		if (scan.send_frames)
+			frame_source = std::make_unique<cv::VideoCapture>(scan.video_path);
+		int consecutive_failures = 0;
+		while (!canceled.load()) {
+			Shard shard;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (queue.empty()) {
+					if (in_flight == 0)
+						break;
+				}
+				else {
+					shard = queue.front();
+					queue.pop_front();
+					++in_flight;
+				}
+			}
+			if (shard.last == 0) {
+				// Other workers still hold shards that may come back for a retry
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				continue;
+			}
+
+			Detections detections;
+			std::string error;
+			bool ok = true;
+			if (socket.state() != QAbstractSocket::ConnectedState) {
+				socket.abort();
+				socket.connectToHost(QString::fromStdString(address.host), static_cast<quint16>(address.port));
+				ok = socket.waitForConnected(connect_timeout_ms);
+				if (!ok)
+					error = socket.errorString().toStdString();
+			}
+			const quint64 job_id = next_job++;
+			QByteArray request;
+			if (ok)
+				ok = build_request(job_id, scan, shard, frame_source.get(), request, error);
+			if (ok) {
+				ok = write_message(socket, request);
+				QByteArray response;
+				ok = ok && read_message(socket, response, is_canceled);
+				ok = ok && parse_response(response, job_id, detections, error);
+				if (!ok && error.empty())
+					error = socket.errorString().toStdString();
+			}
+
+			std::lock_guard<std::mutex> guard(lock);
+			--in_flight;
+			if (ok) {
+				consecutive_failures = 0;
+				for (auto& d : detections)
+					result.corners[d.first] = d.second;
+				++finished;
+				if (progress && !progress(finished, result.shards))
+					canceled.store(true);
+				continue;
+			}
+			socket.abort();
+			if (canceled.load())
+				break;
+			++consecutive_failures;
+			if (++shard.attempts < scan.max_attempts) {
+				++result.retried_shards;
+				queue.push_back(shard);
+			}
+			else {
+				++result.failed_shards;
+				++finished;
+				if (result.error.empty())
+					result.error = "Shard " + std::to_string(shard.first) + "-" + std::to_string(shard.last) + " failed: " + error;
+			}
+			// A worker that keeps failing is dropped, its shards go to the others
+			if (consecutive_failures >= scan.max_attempts) {
+				++result.lost_workers;
+				--live_workers;
+				break;
+			}
+		}
+		std::lock_guard<std::mutex> guard(lock);
+		if (live_workers == 0 && !queue.empty() && result.error.empty())
+			result.error = "All workers failed";
+	};
+
+	std::vector<std::thread> threads;
+	for (auto& w : workers)
+		threads.emplace_back(worker_loop, w);
+	for (auto& t : threads)
+		t.join();
+
+	if (canceled.load()) {
+		result.error = "Canceled";
+		return result;
+	}
+	result.failed_shards += static_cast<int>(queue.size());
+	result.success = result.failed_shards == 0;
+	return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "calibration.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+constexpr int default_worker_port = 5150;
+
+struct WorkerAddress {
+	std::string host;
+	int port = default_worker_port;
+};
+
+// Describes a scan of one clip, split into shards of frame ranges across workers.
+// Workers either open video_path themselves, or get encoded frames when send_frames is set
+struct DistributedScan {
+	std::string video_path;
+	bool send_frames = false;
+	int first_frame = 1;
+	int last_frame = 1;
+	int frame_step = 1;
+	cv::Size board_size;
+	// Source frames per shard, 0 picks a size from the worker count. Capped so every shard
+	// replies within the idle timeout
+	int shard_frames = 0;
+	int max_attempts = 3;
+};
+
+struct DistributedScanResult {
+	std::map<int, ChessboardCorners> corners;
+	int shards = 0;
+	int retried_shards = 0;
+	int failed_shards = 0;
+	int lost_workers = 0;
+	std::string error;
+	bool success = false;
+};
+
+const std::vector<WorkerAddress> parse_worker_addresses(const std::string& list);
+
+// Serves detection jobs on the given address until the process is terminated. An empty address
+// listens on localhost only, video jobs may only name existing local files
+int run_detection_worker(const std::string& listen_address, const int port);
+
+const DistributedScanResult run_distributed_scan(const std::vector<WorkerAddress>& workers, const DistributedScan& scan,
+	const SolveProgress& progress = nullptr);
@@ -0,0 +1,100 @@
+#include "frame.hpp"
+
+const bool VideoFrame::empty() const
+{
+	return raw.empty();
+}
+
+const cv::Mat VideoFrame::luma() const
+{
+	// Planar layouts store the Y plane first, so luma is only a header over the decoded buffer
+	switch (layout) {
+	case FrameLayout::gray:
+		return raw;
+	case FrameLayout::i420:
+	case FrameLayout::nv12:
+		return raw.rowRange(0, size.height);
+	case FrameLayout::yuyv: {
+		cv::Mat out;
+		cv::extractChannel(raw, out, 0);
+		return out;
+	}
+	default: {
+		cv::Mat out;
+		cv::cvtColor(raw, out, cv::COLOR_BGR2GRAY);
+		return out;
+	}
+	}
+}
+
+const cv::Mat VideoFrame::detection_image() const
+{
+	if (layout == FrameLayout::bgr)
+		return raw;
+	return luma();
+}
+
+void VideoFrame::to_bgr(cv::Mat& out) const
+{
+	switch (layout) {
+	case FrameLayout::gray:
+		cv::cvtColor(raw, out, cv::COLOR_GRAY2BGR);
+		break;
+	case FrameLayout::i420:
+		cv::cvtColor(raw, out, cv::COLOR_YUV2BGR_I420);
+		break;
+	case FrameLayout::nv12:
+		cv::cvtColor(raw, out, cv::COLOR_YUV2BGR_NV12);
+		break;
+	case FrameLayout::yuyv:
+		cv::cvtColor(raw, out, cv::COLOR_YUV2BGR_YUYV);
+		break;
+	default:
+		raw.copyTo(out);
+		break;
+	}
+}
+
+void VideoFrame::copy_to(VideoFrame& out) const
+{
+	raw.copyTo(out.raw);
+	out.layout = layout;
+	out.size = size;
+}
+
+bool set_luma_decode(cv::VideoCapture& cap, const bool enable)
+{
+	if (!cap.isOpened())
+		return false;
+	return cap.set(cv::CAP_PROP_CONVERT_RGB, enable ? 0.0 : 1.0);
+}
+
+bool read_frame(cv::VideoCapture& cap, VideoFrame& frame)
+{
+	if (!cap.read(frame.raw) || frame.raw.empty())
+		return false;
+	const int w = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
+	const int h = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+	const cv::Mat& raw = frame.raw;
+	if (raw.type() == CV_8UC3) {
+		frame.layout = FrameLayout::bgr;
+		frame.size = raw.size();
+	}
+	else if (raw.type() == CV_8UC2) {
+		frame.layout = FrameLayout::yuyv;
+		frame.size = raw.size();
+	}
+	else if (raw.type() == CV_8UC1 && raw.cols == w && raw.rows == h * 3 / 2) {
+		// Both 4:2:0 layouts share the Y plane, the pixel format only matters for colour conversion
+		const int fourcc = static_cast<int>(cap.get(cv::CAP_PROP_CODEC_PIXEL_FORMAT));
+		frame.layout = (fourcc == cv::VideoWriter::fourcc('N', 'V', '1', '2')) ? FrameLayout::nv12 : FrameLayout::i420;
+		frame.size = cv::Size(w, h);
+	}
+	else if (raw.type() == CV_8UC1) {
+		frame.layout = FrameLayout::gray;
+		frame.size = raw.size();
+	}
+	else
+		return false;
+	return true;
+}
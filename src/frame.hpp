@@ -0,0 +1,31 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+// Pixel layout of a frame as handed out by the capture backend
+enum class FrameLayout {
+	bgr,
+	gray,
+	i420,
+	nv12,
+	yuyv
+};
+
+struct VideoFrame {
+	cv::Mat raw;
+	FrameLayout layout = FrameLayout::bgr;
+	cv::Size size;
+	const bool empty() const;
+	const cv::Mat luma() const;
+	// Input for the detectors: the luma plane where it is only a header, otherwise the BGR data.
+	// get_corners and board_plausible convert BGR on reused scratch buffers
+	const cv::Mat detection_image() const;
+	void to_bgr(cv::Mat& out) const;
+	void copy_to(VideoFrame& out) const;
+};
+
+// Asks the backend to hand out frames in their native format instead of converting to BGR.
+// Backends that ignore this keep returning BGR, which read_frame handles transparently
+bool set_luma_decode(cv::VideoCapture& cap, const bool enable);
+
+bool read_frame(cv::VideoCapture& cap, VideoFrame& frame);
@@ -0,0 +1,155 @@
+#include "framepool.hpp"
+#include <algorithm>
+
+struct FrameRef::Slot {
+	VideoFrame frame;
+	std::atomic<int> refs{ 0 };
+	// Storage handed out, to tell reallocation by the user apart from reuse
+	const uchar* data = nullptr;
+	// Only set while checked out, so idle slots do not keep the pool alive
+	std::shared_ptr<FramePool::State> owner;
+};
+
+struct FramePool::State {
+	mutable std::mutex lock;
+	std::vector<std::unique_ptr<FrameRef::Slot>> slots;
+	std::vector<FrameRef::Slot*> idle;
+	size_t acquisitions = 0;
+	size_t allocations = 0;
+
+	void release(FrameRef::Slot* slot)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (slot->frame.raw.data != slot->data && !slot->frame.raw.empty())
+			++allocations;
+		idle.push_back(slot);
+	}
+};
+
+FrameRef::FrameRef(Slot* slot)
+	: slot(slot)
+{
+	if (slot)
+		++slot->refs;
+}
+
+FrameRef::FrameRef(const FrameRef& other)
+	: FrameRef(other.slot)
+{
+}
+
+FrameRef::FrameRef(FrameRef&& other) noexcept
+	: slot(other.slot)
+{
+	other.slot = nullptr;
+}
+
+FrameRef& FrameRef::operator=(const FrameRef& other)
+{
+	if (slot != other.slot) {
+		FrameRef copy(other);
+		std::swap(slot, copy.slot);
+	}
+	return *this;
+}
+
+FrameRef& FrameRef::operator=(FrameRef&& other) noexcept
+{
+	if (this != &other) {
+		reset();
+		std::swap(slot, other.slot);
+	}
+	return *this;
+}
+
+FrameRef::~FrameRef()
+{
+	reset();
+}
+
+void FrameRef::reset()
+{
+	Slot* released = slot;
+	slot = nullptr;
+	if (!released || --released->refs > 0)
+		return;
+	// The pool may have been destroyed already, in which case this is its last reference and the
+	// slot is freed along with it. Nothing touches the slot after handing it back
+	auto owner = std::move(released->owner);
+	owner->release(released);
+}
+
+FrameRef::operator bool() const
+{
+	return slot != nullptr;
+}
+
+VideoFrame& FrameRef::operator*() const
+{
+	return slot->frame;
+}
+
+VideoFrame* FrameRef::operator->() const
+{
+	return &slot->frame;
+}
+
+FramePool::FramePool()
+	: state(std::make_shared<State>())
+{
+}
+
+FramePool::~FramePool() = default;
+
+void FramePool::reserve(const VideoFrame& frame, const size_t count)
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	auto& idle = state->idle;
+	idle.erase(std::remove_if(idle.begin(), idle.end(), [&](FrameRef::Slot* slot) {
+		if (slot->frame.raw.size() == frame.raw.size() && slot->frame.raw.type() == frame.raw.type())
+			return false;
+		auto& slots = state->slots;
+		slots.erase(std::find_if(slots.begin(), slots.end(), [&](auto& s) { return s.get() == slot; }));
+		return true;
+	}), idle.end());
+	while (idle.size() < count) {
+		state->slots.push_back(std::make_unique<FrameRef::Slot>());
+		auto slot = state->slots.back().get();
+		slot->frame.raw.create(frame.raw.size(), frame.raw.type());
+		slot->frame.layout = frame.layout;
+		slot->frame.size = frame.size;
+		idle.push_back(slot);
+		++state->allocations;
+	}
+}
+
+FrameRef FramePool::acquire()
+{
+	FrameRef::Slot* slot = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(state->lock);
+		++state->acquisitions;
+		if (state->idle.empty()) {
+			state->slots.push_back(std::make_unique<FrameRef::Slot>());
+			slot = state->slots.back().get();
+		}
+		else {
+			slot = state->idle.back();
+			state->idle.pop_back();
+		}
+	}
+	slot->data = slot->frame.raw.data;
+	slot->owner = state;
+	return FrameRef(slot);
+}
+
+const FramePoolStats FramePool::stats() const
+{
+	std::lock_guard<std::mutex> guard(state->lock);
+	FramePoolStats out;
+	out.buffers = state->slots.size();
+	out.in_use = state->slots.size() - state->idle.size();
+	out.acquisitions = state->acquisitions;
+	out.allocations = state->allocations;
+	return out;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "frame.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct FramePoolStats {
+	size_t buffers = 0;
+	size_t in_use = 0;
+	size_t acquisitions = 0;
+	// Buffers created by the pool plus pixel storage the decoder had to reallocate
+	size_t allocations = 0;
+};
+
+class FramePool;
+
+// Reference counted handle to a pooled frame. Copies share the frame, and its buffer goes back
+// to the pool once the last handle is dropped. Copying and dropping handles never allocates
+class FrameRef {
+public:
+	FrameRef() = default;
+	FrameRef(const FrameRef& other);
+	FrameRef(FrameRef&& other) noexcept;
+	FrameRef& operator=(const FrameRef& other);
+	FrameRef& operator=(FrameRef&& other) noexcept;
+	~FrameRef();
+
+	void reset();
+	explicit operator bool() const;
+	VideoFrame& operator*() const;
+	VideoFrame* operator->() const;
+
+private:
+	friend class FramePool;
+	struct Slot;
+	explicit FrameRef(Slot* slot);
+	Slot* slot = nullptr;
+};
+
+// Frame buffers recycled between decode, detection and display. A released buffer keeps its
+// pixel storage, so a decoder reading into it again at the clip resolution does not allocate.
+// Handles may outlive the pool and be released from any thread
+class FramePool {
+public:
+	FramePool();
+	~FramePool();
+	FramePool(const FramePool&) = delete;
+	FramePool& operator=(const FramePool&) = delete;
+
+	// Drops idle buffers of another geometry and allocates up to count idle buffers shaped like frame
+	void reserve(const VideoFrame& frame, const size_t count);
+	// Hands out an idle buffer, or a new one when all are in use. The frame keeps its old contents
+	FrameRef acquire();
+	const FramePoolStats stats() const;
+
+private:
+	friend class FrameRef;
+	struct State;
+	std::shared_ptr<State> state;
+};
@@ -0,0 +1,249 @@
+#include "livecapture.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+
+namespace {
+	// Cameras and streams drop single frames routinely, only a run of failures means the source is gone
+	constexpr int max_failed_reads = 5;
+	constexpr int max_reopen_attempts = 3;
+	constexpr std::chrono::milliseconds retry_delay(20);
+	constexpr std::chrono::milliseconds max_retry_delay(500);
+}
+
+LiveCapture::~LiveCapture()
+{
+	stop();
+}
+
+bool LiveCapture::start(const std::string& source, const cv::Size& board_size, const bool luma_decode,
+	const int max_jobs, DetectionCallback on_detection)
+{
+	stop();
+	this->source = source;
+	is_device = !source.empty() && std::all_of(source.begin(), source.end(), [](unsigned char c) { return std::isdigit(c); });
+	this->luma_decode = luma_decode;
+	if (!open_source())
+		return false;
+
+	// Files and other seekable sources report a frame count, devices and live streams do not
+	paced = !is_device && cap.get(cv::CAP_PROP_FRAME_COUNT) > 0;
+	fps = cap.get(cv::CAP_PROP_FPS);
+	if (!(fps > 0.0))
+		fps = 30.0;
+	size = cv::Size(static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT)));
+	this->max_jobs = std::max(1, max_jobs);
+	callback = std::move(on_detection);
+	set_board_size(board_size);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		latest.reset();
+		latest_index = 0;
+		latest_taken = true;
+		jobs = 0;
+		counters = LiveStats();
+		latencies.clear();
+		end_reason.clear();
+		start_time = Clock::now();
+	}
+	stopping = false;
+	active = true;
+	capture_thread = std::thread(&LiveCapture::capture_loop, this);
+	return true;
+}
+
+void LiveCapture::stop()
+{
+	stopping = true;
+	if (capture_thread.joinable())
+		capture_thread.join();
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		jobs_done.wait(guard, [this]() { return jobs == 0; });
+	}
+	active = false;
+	cap.release();
+	std::lock_guard<std::mutex> guard(lock);
+	end_reason.clear();
+}
+
+bool LiveCapture::running() const
+{
+	return active.load();
+}
+
+void LiveCapture::set_board_size(const cv::Size& board_size)
+{
+	board_width = board_size.width;
+	board_height = board_size.height;
+}
+
+FrameRef LiveCapture::latest_frame(int& index) const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	index = latest_index;
+	return latest;
+}
+
+cv::Size LiveCapture::frame_size() const
+{
+	return size;
+}
+
+LiveStats LiveCapture::stats() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	LiveStats out = counters;
+	const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+	if (seconds > 0.0)
+		out.capture_fps = counters.captured / seconds;
+	if (!latencies.empty()) {
+		std::vector<double> sorted(latencies.begin(), latencies.end());
+		std::sort(sorted.begin(), sorted.end());
+		out.latency_mean_ms = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+		out.latency_p95_ms = sorted.at(std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * 0.95)));
+		out.latency_max_ms = sorted.back();
+	}
+	const auto pool_stats = pool.stats();
+	out.frame_buffers = pool_stats.buffers;
+	out.frame_allocations = pool_stats.allocations;
+	return out;
+}
+
+std::string LiveCapture::error() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return end_reason;
+}
+
+bool LiveCapture::open_source()
+{
+	cap.release();
+	if (is_device)
+		cap.open(std::stoi(source));
+	else
+		cap.open(source);
+	if (!cap.isOpened())
+		return false;
+	set_luma_decode(cap, luma_decode);
+	return true;
+}
+
+bool LiveCapture::wait_for_retry(const std::chrono::milliseconds delay)
+{
+	// Sleeps in short slices so stop() is not held up by the backoff
+	const auto until = Clock::now() + delay;
+	while (!stopping && Clock::now() < until)
+		std::this_thread::sleep_for(std::min<Clock::duration>(until - Clock::now(), std::chrono::milliseconds(10)));
+	return !stopping;
+}
+
+void LiveCapture::capture_loop()
+{
+	const auto frame_interval = std::chrono::duration<double>(1.0 / fps);
+	const auto loop_start = Clock::now();
+	int index = 0;
+	int failed_reads = 0;
+	int reopen_attempts = 0;
+	std::string reason;
+	while (!stopping) {
+		// Buffers come back from detection and display once they move on, so capture cycles
+		// through a handful of them at the stream resolution
+		auto frame = pool.acquire();
+		if (!read_frame(cap, *frame)) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				++counters.read_failures;
+			}
+			const auto delay = std::min(max_retry_delay, retry_delay * (1 << std::min(failed_reads, 5)));
+			if (++failed_reads < max_failed_reads) {
+				if (!wait_for_retry(delay))
+					break;
+				continue;
+			}
+			// A replayed file that keeps failing has reached its end, reopening would start it over
+			if (paced)
+				break;
+			if (reopen_attempts >= max_reopen_attempts) {
+				reason = "source lost, reopening failed " + std::to_string(max_reopen_attempts) + " times";
+				break;
+			}
+			++reopen_attempts;
+			if (!wait_for_retry(delay))
+				break;
+			if (open_source()) {
+				failed_reads = 0;
+				std::lock_guard<std::mutex> guard(lock);
+				++counters.reconnects;
+			}
+			continue;
+		}
+		failed_reads = 0;
+		reopen_attempts = 0;
+		++index;
+		if (paced)
+			std::this_thread::sleep_until(loop_start + std::chrono::duration_cast<Clock::duration>(frame_interval * index));
+
+		bool launch = false;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!latest_taken)
+				++counters.dropped;
+			latest = std::move(frame);
+			latest_index = index;
+			latest_time = Clock::now();
+			latest_taken = false;
+			++counters.captured;
+			if (jobs < max_jobs) {
+				++jobs;
+				launch = true;
+			}
+		}
+		if (launch)
+			TaskScheduler::global().submit([this]() { detect_job(); });
+	}
+	if (!stopping) {
+		std::lock_guard<std::mutex> guard(lock);
+		end_reason = reason;
+	}
+	active = false;
+}
+
+void LiveCapture::detect_job()
+{
+	while (true) {
+		FrameRef frame;
+		int index;
+		Clock::time_point captured_at;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (latest_taken || stopping) {
+				// Notify under the lock, stop() may destroy this object as soon as it sees jobs == 0
+				--jobs;
+				jobs_done.notify_all();
+				return;
+			}
+			frame = latest;
+			index = latest_index;
+			captured_at = latest_time;
+			latest_taken = true;
+		}
+
+		LiveDetection detection;
+		detection.frame = index;
+		detection.corners = get_corners(frame->detection_image(), board_width, board_height);
+		detection.latency_ms = std::chrono::duration<double, std::milli>(Clock::now() - captured_at).count();
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			++counters.processed;
+			if (detection.corners.valid)
+				++counters.detections;
+			latencies.push_back(detection.latency_ms);
+			if (latencies.size() > 256)
+				latencies.pop_front();
+		}
+		if (detection.corners.valid && callback)
+			callback(detection);
+	}
+}
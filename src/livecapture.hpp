@@ -0,0 +1,97 @@
+#pragma once
+
+#include "calibration.hpp"
+#include "framepool.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct LiveStats {
+	int captured = 0;
+	int processed = 0;
+	int dropped = 0;
+	int detections = 0;
+	double capture_fps = 0.0;
+	double latency_mean_ms = 0.0;
+	double latency_p95_ms = 0.0;
+	double latency_max_ms = 0.0;
+	size_t frame_buffers = 0;
+	size_t frame_allocations = 0;
+	int read_failures = 0;
+	int reconnects = 0;
+};
+
+struct LiveDetection {
+	int frame = 0;
+	ChessboardCorners corners;
+	double latency_ms = 0.0;
+};
+
+// Reads a camera or stream on its own thread and runs detection on the task scheduler.
+// Detection jobs always pick up the newest frame, anything they could not get to is dropped.
+// Video files are replayed at their nominal frame rate so they can stand in for a camera.
+// Failed reads are retried with a short backoff, and cameras and streams are reopened after
+// several failures in a row. The session only ends once reopening fails as well
+class LiveCapture {
+public:
+	using DetectionCallback = std::function<void(const LiveDetection&)>;
+
+	LiveCapture() = default;
+	~LiveCapture();
+	LiveCapture(const LiveCapture&) = delete;
+	LiveCapture& operator=(const LiveCapture&) = delete;
+
+	bool start(const std::string& source, const cv::Size& board_size, const bool luma_decode,
+		const int max_jobs, DetectionCallback on_detection);
+	void stop();
+	bool running() const;
+	void set_board_size(const cv::Size& board_size);
+	// The handle shares the capture's buffer, which is recycled once every holder lets go of it
+	FrameRef latest_frame(int& index) const;
+	cv::Size frame_size() const;
+	LiveStats stats() const;
+	// Why a camera or stream was given up on, empty when running, stopped or at the end of a file
+	std::string error() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	cv::VideoCapture cap;
+	std::string source;
+	bool is_device = false;
+	bool luma_decode = false;
+	cv::Size size;
+	bool paced = false;
+	double fps = 30.0;
+	int max_jobs = 1;
+	DetectionCallback callback;
+	std::thread capture_thread;
+	std::atomic<bool> stopping{ false };
+	std::atomic<bool> active{ false };
+	std::atomic<int> board_width{ 0 };
+	std::atomic<int> board_height{ 0 };
+
+	mutable std::mutex lock;
+	std::condition_variable jobs_done;
+	FramePool pool;
+	FrameRef latest;
+	int latest_index = 0;
+	Clock::time_point latest_time;
+	bool latest_taken = true;
+	int jobs = 0;
+	Clock::time_point start_time;
+	LiveStats counters;
+	std::deque<double> latencies;
+	std::string end_reason;
+
+	bool open_source();
+	bool wait_for_retry(const std::chrono::milliseconds delay);
+	void capture_loop();
+	void detect_job();
+};
@@ -1,8 +1,51 @@
 #include <QApplication>
+#include <QByteArray>
+#include <QCommandLineParser>
+#include "benchmark.hpp"
 #include "calibration.hpp"
+#include "distributed.hpp"
+#include "scheduler.hpp"
 #include "window.h"
 #include <opencv2/opencv.hpp>
 #include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <cstdio>
+#endif
+
+// Headless modes must not create a QApplication, since there may be no display to connect to
+bool is_headless(int argc, char* argv[]) {
+    const char* headless_options[] = { "--benchmark", "--worker" };
+    for (int i = 1; i < argc; ++i) {
+        for (auto option : headless_options) {
+            if (qstrcmp(argv[i], option) == 0 || QByteArray(argv[i]).startsWith(QByteArray(option) + '='))
+                return true;
+        }
+    }
+    return false;
+}
+
+// The executable uses the GUI subsystem on Windows, which starts without a console. Headless modes
+// write to the console they were started from, streams redirected to a file or pipe are kept
+void attach_parent_console() {
+#ifdef _WIN32
+    if (!AttachConsole(ATTACH_PARENT_PROCESS))
+        return;
+    FILE* stream = nullptr;
+    if (GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_UNKNOWN)
+        freopen_s(&stream, "CONOUT$", "w", stdout);
+    if (GetFileType(GetStdHandle(STD_ERROR_HANDLE)) == FILE_TYPE_UNKNOWN)
+        freopen_s(&stream, "CONOUT$", "w", stderr);
+    std::cout.clear();
+    std::cerr.clear();
+#endif
+}
 
 std::vector<cv::Mat> get_frames(cv::VideoCapture& cap, int num_frames) {
     std::vector<cv::Mat> output;
@@ -25,8 +68,63 @@ std::vector<cv::Mat> get_frames(cv::VideoCapture& cap, int num_frames) {
 
 int main(int argc, char* argv[])
 {
-    QApplication app(argc, argv);
+    // OpenCV reads this once, when the EXR codec is first used. It is set before Qt or the scheduler
+    // start any threads, since changing the environment while other threads read it is a race
+    if (!qEnvironmentVariableIsSet("OPENCV_IO_ENABLE_OPENEXR"))
+        qputenv("OPENCV_IO_ENABLE_OPENEXR", "1");
+    std::unique_ptr<QCoreApplication> app;
+    if (is_headless(argc, argv)) {
+        attach_parent_console();
+        app = std::make_unique<QCoreApplication>(argc, argv);
+    }
+    else
+        app = std::make_unique<QApplication>(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption threads_option("threads", "Number of worker threads used for all parallel work (0 = all cores)", "count", "0");
+    QCommandLineOption benchmark_option("benchmark", "Run benchmark suites headless and exit. Comma separated list or \"all\"", "suites");
+    QCommandLineOption output_option("output", "File benchmark results are written to (default: stdout)", "path");
+    QCommandLineOption worker_option("worker", "Run headless as a detection worker for distributed scans");
+    QCommandLineOption port_option("port", "Port a detection worker listens on", "port", QString::number(default_worker_port));
+    QCommandLineOption listen_option("listen", "Address a detection worker listens on, e.g. 0.0.0.0 for all interfaces (default: localhost only)", "address");
+    parser.addOption(threads_option);
+    parser.addOption(benchmark_option);
+    parser.addOption(output_option);
+    parser.addOption(worker_option);
+    parser.addOption(port_option);
+    parser.addOption(listen_option);
+    parser.process(*app);
+    TaskScheduler scheduler(parser.value(threads_option).toUInt());
+    TaskScheduler::set_global(&scheduler);
+
+    if (parser.isSet(worker_option))
+        return run_detection_worker(parser.value(listen_option).toStdString(), parser.value(port_option).toInt());
+
+    if (parser.isSet(benchmark_option)) {
+        std::vector<std::string> suites;
+        for (auto& s : parser.value(benchmark_option).split(',', Qt::SkipEmptyParts))
+            suites.push_back(s.trimmed().toStdString());
+        std::ofstream out_file;
+        std::ostream* out = &std::cout;
+        if (parser.isSet(output_option)) {
+            out_file.open(parser.value(output_option).toStdString(), std::ios::out);
+            if (!out_file.is_open()) {
+                std::cerr << "Failed writing to \"" << parser.value(output_option).toStdString() << "\"" << std::endl;
+                return 1;
+            }
+            out = &out_file;
+        }
+        const int status = run_benchmarks(suites, *out);
+        if (status != 0) {
+            std::cerr << "Unknown benchmark suite. Available:";
+            for (auto& name : benchmark_suites())
+                std::cerr << " " << name;
+            std::cerr << std::endl;
+        }
+        return status;
+    }
+
     window w;
     w.show();
-    return app.exec();
+    return app->exec();
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "presence.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// Checker response of four box sums, a and d on one diagonal and b and c on the other: how far
+	// the lighter pair sits above the darker one, less the spread within each pair. Plain edges and
+	// single corners score zero or below, also on top of a brightness gradient
+	inline int checker_response(const int a, const int b, const int c, const int d)
+	{
+		const int separation = std::max(std::min(a, d) - std::max(b, c), std::min(b, c) - std::max(a, d));
+		return separation - (std::abs(a - d) + std::abs(b - c)) / 2;
+	}
+
+	inline int box_sum(const cv::Mat& integral, const int x0, const int y0, const int x1, const int y1)
+	{
+		const int* r0 = integral.ptr<int>(y0);
+		const int* r1 = integral.ptr<int>(y1);
+		return r1[x1] - r0[x1] - r1[x0] + r0[x0];
+	}
+
+	// Per thread buffers, reused while the frame size stays the same
+	struct PresenceScratch {
+		cv::Mat gray;
+		cv::Mat small;
+		cv::Mat integral;
+		cv::Mat response;
+		cv::Mat peaks;
+	};
+
+	// Junctions at one box size: responses above threshold that are the maximum of their neighbourhood
+	int count_junctions(PresenceScratch& scratch, const int r, const double min_contrast)
+	{
+		const cv::Mat& integral = scratch.integral;
+		cv::Mat& response = scratch.response;
+		// Diagonal boxes are r wide and centred r away, so both layouts cover the same area
+		const int h = r / 2;
+		const int margin = r + h;
+		const int w = integral.cols - 1;
+		const int ht = integral.rows - 1;
+		response.create(ht, w, CV_32F);
+		response.setTo(cv::Scalar(0));
+		if (w <= 2 * margin || ht <= 2 * margin)
+			return 0;
+		// A perfect checker scores its contrast times the box area
+		const int threshold = static_cast<int>(min_contrast * r * r);
+		for (int y = margin; y < ht - margin; ++y) {
+			const int* rt = integral.ptr<int>(y - r);
+			const int* rc = integral.ptr<int>(y);
+			const int* rb = integral.ptr<int>(y + r);
+			float* out = response.ptr<float>(y);
+			for (int x = margin; x < w - margin; ++x) {
+				// The 3x3 grid of integral samples shared by the four quadrants
+				const int tl = rt[x - r], tc = rt[x], tr = rt[x + r];
+				const int cl = rc[x - r], cc = rc[x], cr = rc[x + r];
+				const int bl = rb[x - r], bc = rb[x], br = rb[x + r];
+				const int a = cc - tc - cl + tl;
+				const int b = cr - tr - cc + tc;
+				const int c = bc - cc - bl + cl;
+				const int d = br - cr - bc + cc;
+				// Boards near 45 degrees put the squares above, below and beside the junction
+				const int top = box_sum(integral, x - h, y - r - h, x + h, y - r + h);
+				const int bottom = box_sum(integral, x - h, y + r - h, x + h, y + r + h);
+				const int left = box_sum(integral, x - r - h, y - h, x - r + h, y + h);
+				const int right = box_sum(integral, x + r - h, y - h, x + r + h, y + h);
+				const int best = std::max(checker_response(a, b, c, d), checker_response(top, right, left, bottom));
+				if (best > threshold)
+					out[x] = static_cast<float>(best);
+			}
+		}
+
+		const int nms = std::max(1, r / 2);
+		cv::Mat& peaks = scratch.peaks;
+		cv::dilate(response, peaks, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2 * nms + 1, 2 * nms + 1)));
+		int count = 0;
+		for (int y = margin; y < ht - margin; ++y) {
+			const float* v = response.ptr<float>(y);
+			const float* p = peaks.ptr<float>(y);
+			for (int x = margin; x < w - margin; ++x) {
+				if (v[x] > 0.0f && v[x] >= p[x])
+					++count;
+			}
+		}
+		return count;
+	}
+}
+
+const PresenceResult board_presence(const cv::Mat& image, const cv::Size& board_size, const PresenceOptions& options)
+{
+	PresenceResult result;
+	result.expected = board_size.area();
+	if (image.empty() || result.expected <= 0)
+		return result;
+
+	thread_local PresenceScratch scratch;
+	cv::Mat gray;
+	if (image.channels() == 1)
+		gray = image;
+	else {
+		cv::cvtColor(image, scratch.gray, cv::COLOR_BGR2GRAY);
+		gray = scratch.gray;
+	}
+	cv::Mat small;
+	const double scale = static_cast<double>(options.max_side) / std::max(gray.cols, gray.rows);
+	if (scale < 1.0) {
+		cv::resize(gray, scratch.small, cv::Size(), scale, scale, cv::INTER_AREA);
+		small = scratch.small;
+	}
+	else
+		small = gray;
+	cv::integral(small, scratch.integral, CV_32S);
+
+	// Small boxes resolve boards far from the camera, large ones average out noise on close boards
+	for (const int r : { 2, 4 })
+		result.junctions = std::max(result.junctions, count_junctions(scratch, r, options.min_contrast));
+	result.plausible = result.junctions >= std::max(4, static_cast<int>(std::ceil(options.min_fraction * result.expected)));
+	return result;
+}
+
+bool board_plausible(const cv::Mat& image, const cv::Size& board_size, const PresenceOptions& options)
+{
+	return board_presence(image, board_size, options).plausible;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+struct PresenceOptions {
+	// Longest side of the downscaled image the response is computed on
+	int max_side = 320;
+	// Minimum mean difference between light and dark quadrants, in gray levels
+	double min_contrast = 8.0;
+	// Fraction of the board's inner corners that must show up as junctions
+	double min_fraction = 0.5;
+};
+
+struct PresenceResult {
+	int junctions = 0;
+	int expected = 0;
+	bool plausible = true;
+};
+
+// Counts X-junction candidates with box filters on the integral image of a downscaled frame.
+// Axis aligned and diagonal quadrant layouts are both tested, at two box sizes, and the best
+// count is compared against the number of inner corners of the board
+const PresenceResult board_presence(const cv::Mat& image, const cv::Size& board_size, const PresenceOptions& options = PresenceOptions());
+
+// Fast rejection test run ahead of get_corners. False means the frame cannot hold the full board
+bool board_plausible(const cv::Mat& image, const cv::Size& board_size, const PresenceOptions& options = PresenceOptions());
@@ -0,0 +1,128 @@
+#include "reprojection.hpp"
+#include "scheduler.hpp"
+#include <cmath>
+#include <functional>
+#include <numeric>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+	// Views per scheduler task. Small batches are evaluated inline, where the dispatch would cost more than the work
+	constexpr size_t views_per_task = 8;
+
+	struct Camera {
+		double fx, fy, cx, cy, skew, k1, k2, k3;
+	};
+
+	double project_view(const Camera& c, const cv::Matx33d& R, const cv::Vec3d& t,
+		const cv::Point3f* obj, const cv::Point2f* img, const size_t n, float* err)
+	{
+		double sum_sq = 0.0;
+		size_t i = 0;
+#if defined(__AVX2__)
+		const __m256d r00 = _mm256_set1_pd(R(0, 0)), r01 = _mm256_set1_pd(R(0, 1)), r02 = _mm256_set1_pd(R(0, 2));
+		const __m256d r10 = _mm256_set1_pd(R(1, 0)), r11 = _mm256_set1_pd(R(1, 1)), r12 = _mm256_set1_pd(R(1, 2));
+		const __m256d r20 = _mm256_set1_pd(R(2, 0)), r21 = _mm256_set1_pd(R(2, 1)), r22 = _mm256_set1_pd(R(2, 2));
+		const __m256d t0 = _mm256_set1_pd(t(0)), t1 = _mm256_set1_pd(t(1)), t2 = _mm256_set1_pd(t(2));
+		const __m256d fx = _mm256_set1_pd(c.fx), fy = _mm256_set1_pd(c.fy), cx = _mm256_set1_pd(c.cx), cy = _mm256_set1_pd(c.cy);
+		const __m256d skew = _mm256_set1_pd(c.skew), k1 = _mm256_set1_pd(c.k1), k2 = _mm256_set1_pd(c.k2), k3 = _mm256_set1_pd(c.k3);
+		const __m256d one = _mm256_set1_pd(1.0);
+		__m256d acc = _mm256_setzero_pd();
+		for (; i + 4 <= n; i += 4) {
+			const __m256d px = _mm256_set_pd(obj[i + 3].x, obj[i + 2].x, obj[i + 1].x, obj[i].x);
+			const __m256d py = _mm256_set_pd(obj[i + 3].y, obj[i + 2].y, obj[i + 1].y, obj[i].y);
+			const __m256d pz = _mm256_set_pd(obj[i + 3].z, obj[i + 2].z, obj[i + 1].z, obj[i].z);
+			const __m256d X = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r00, px), _mm256_mul_pd(r01, py)), _mm256_add_pd(_mm256_mul_pd(r02, pz), t0));
+			const __m256d Y = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r10, px), _mm256_mul_pd(r11, py)), _mm256_add_pd(_mm256_mul_pd(r12, pz), t1));
+			const __m256d Z = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r20, px), _mm256_mul_pd(r21, py)), _mm256_add_pd(_mm256_mul_pd(r22, pz), t2));
+			const __m256d iz = _mm256_div_pd(one, Z);
+			const __m256d x = _mm256_mul_pd(X, iz);
+			const __m256d y = _mm256_mul_pd(Y, iz);
+			const __m256d r2 = _mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y));
+			const __m256d radial = _mm256_add_pd(one, _mm256_mul_pd(r2, _mm256_add_pd(k1, _mm256_mul_pd(r2, _mm256_add_pd(k2, _mm256_mul_pd(r2, k3))))));
+			const __m256d xd = _mm256_mul_pd(x, radial);
+			const __m256d yd = _mm256_mul_pd(y, radial);
+			const __m256d u = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(fx, xd), _mm256_mul_pd(skew, yd)), cx);
+			const __m256d v = _mm256_add_pd(_mm256_mul_pd(fy, yd), cy);
+			const __m256d du = _mm256_sub_pd(u, _mm256_set_pd(img[i + 3].x, img[i + 2].x, img[i + 1].x, img[i].x));
+			const __m256d dv = _mm256_sub_pd(v, _mm256_set_pd(img[i + 3].y, img[i + 2].y, img[i + 1].y, img[i].y));
+			const __m256d d2 = _mm256_add_pd(_mm256_mul_pd(du, du), _mm256_mul_pd(dv, dv));
+			acc = _mm256_add_pd(acc, d2);
+			_mm_storeu_ps(err + i, _mm256_cvtpd_ps(_mm256_sqrt_pd(d2)));
+		}
+		alignas(32) double lanes[4];
+		_mm256_store_pd(lanes, acc);
+		sum_sq = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+		for (; i < n; ++i) {
+			const cv::Vec3d P(obj[i].x, obj[i].y, obj[i].z);
+			const cv::Vec3d X = R * P + t;
+			const double x = X(0) / X(2);
+			const double y = X(1) / X(2);
+			const double r2 = x * x + y * y;
+			const double radial = 1 + r2 * (c.k1 + r2 * (c.k2 + r2 * c.k3));
+			const double du = c.fx * x * radial + c.skew * y * radial + c.cx - img[i].x;
+			const double dv = c.fy * y * radial + c.cy - img[i].y;
+			const double d2 = du * du + dv * dv;
+			sum_sq += d2;
+			err[i] = static_cast<float>(std::sqrt(d2));
+		}
+		return sum_sq;
+	}
+}
+
+const double ReprojectionErrors::mean_view_error() const
+{
+	if (view.empty())
+		return 0.0;
+	return std::accumulate(view.begin(), view.end(), 0.0) / view.size();
+}
+
+const cv::Matx33d rotation_matrix(const cv::Vec3d& rvec)
+{
+	const double theta = cv::norm(rvec);
+	if (theta < 1e-12)
+		return cv::Matx33d::eye();
+	const cv::Vec3d a = rvec / theta;
+	const double c = std::cos(theta), s = std::sin(theta), C = 1 - c;
+	return cv::Matx33d(
+		c + a(0) * a(0) * C, a(0) * a(1) * C - a(2) * s, a(0) * a(2) * C + a(1) * s,
+		a(1) * a(0) * C + a(2) * s, c + a(1) * a(1) * C, a(1) * a(2) * C - a(0) * s,
+		a(2) * a(0) * C - a(1) * s, a(2) * a(1) * C + a(0) * s, c + a(2) * a(2) * C);
+}
+
+void reprojection_errors(const Kk& cam_Kk, const std::vector<ChessboardCorners>& views, const std::vector<ViewPose>& poses,
+	ReprojectionErrors& out)
+{
+	const size_t num_views = std::min(views.size(), poses.size());
+	out.offsets.resize(num_views + 1);
+	out.offsets.at(0) = 0;
+	for (size_t i = 0; i < num_views; ++i)
+		out.offsets.at(i + 1) = out.offsets.at(i) + std::min(views.at(i).img_corners.size(), views.at(i).obj_corners.size());
+	out.corner.resize(out.offsets.back());
+	out.view.resize(num_views);
+	out.view_rms.resize(num_views);
+
+	const Camera camera{ cam_Kk.K(0, 0), cam_Kk.K(1, 1), cam_Kk.K(0, 2), cam_Kk.K(1, 2), cam_Kk.K(0, 1), cam_Kk.k(0), cam_Kk.k(1), cam_Kk.k(2) };
+	auto evaluate = [&](size_t i) {
+		const size_t n = out.offsets.at(i + 1) - out.offsets.at(i);
+		if (n == 0) {
+			out.view.at(i) = 0.0;
+			out.view_rms.at(i) = 0.0;
+			return;
+		}
+		const double sum_sq = project_view(camera, rotation_matrix(poses.at(i).rvec), poses.at(i).tvec,
+			views.at(i).obj_corners.data(), views.at(i).img_corners.data(), n, out.corner.data() + out.offsets.at(i));
+		out.view.at(i) = std::sqrt(sum_sq) / n;
+		out.view_rms.at(i) = std::sqrt(sum_sq / n);
+	};
+	if (num_views <= views_per_task) {
+		for (size_t i = 0; i < num_views; ++i)
+			evaluate(i);
+	}
+	else {
+		// By reference, so std::function holds a single pointer instead of allocating a copy of the closure
+		TaskScheduler::global().parallel_for(0, num_views, std::ref(evaluate), views_per_task);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "calibration.hpp"
+#include <vector>
+
+// Pose of one view as cv::calibrateCamera returns it, rotation as a Rodrigues vector
+struct ViewPose {
+	cv::Vec3d rvec;
+	cv::Vec3d tvec;
+};
+
+// Per-corner and per-view reprojection errors. Buffers keep their capacity between calls, so once
+// an instance has been sized by a first call, evaluating the same views again does not allocate
+struct ReprojectionErrors {
+	// offsets[i] is the first corner of view i, offsets.back() the corner count
+	std::vector<size_t> offsets;
+	std::vector<float> corner;
+	// sqrt(sum of squared corner errors) / corners, the measure calibrate_camera reports
+	std::vector<double> view;
+	std::vector<double> view_rms;
+	const double mean_view_error() const;
+};
+
+const cv::Matx33d rotation_matrix(const cv::Vec3d& rvec);
+
+// Projects every view's object points through the pinhole model with K1..K3 radial distortion and
+// measures the distance to the detected corners. Views are spread over the task scheduler and
+// corners over SIMD lanes
+void reprojection_errors(const Kk& cam_Kk, const std::vector<ChessboardCorners>& views, const std::vector<ViewPose>& poses,
+	ReprojectionErrors& out);
@@ -0,0 +1,276 @@
+#include "scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <opencv2/core.hpp>
+
+namespace {
+	TaskScheduler* global_scheduler = nullptr;
+
+	// Identifies the scheduler and queue owned by the current thread, if it is a worker
+	thread_local const TaskScheduler* local_owner = nullptr;
+	thread_local size_t local_index = 0;
+
+	// OpenCV keeps its own pool. While the scheduler fans out work, OpenCV calls run serially
+	// so both pools never compete for the same cores; the full budget is restored afterwards
+	std::mutex cv_threads_lock;
+	int cv_threads_regions = 0;
+	int cv_threads_budget = 0;
+
+	struct OpenCVThreadsGuard {
+		OpenCVThreadsGuard() {
+			std::lock_guard<std::mutex> guard(cv_threads_lock);
+			if (cv_threads_regions++ == 0)
+				cv::setNumThreads(1);
+		}
+		~OpenCVThreadsGuard() {
+			std::lock_guard<std::mutex> guard(cv_threads_lock);
+			if (--cv_threads_regions == 0)
+				cv::setNumThreads(cv_threads_budget);
+		}
+	};
+}
+
+TaskScheduler::TaskScheduler(const unsigned int num_threads)
+{
+	unsigned int count = num_threads;
+	if (count == 0)
+		count = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int i = 0; i < count; ++i)
+		queues.push_back(std::make_unique<TaskQueue>());
+	for (unsigned int i = 0; i < count; ++i)
+		workers.emplace_back(&TaskScheduler::worker_loop, this, static_cast<size_t>(i));
+	std::lock_guard<std::mutex> guard(cv_threads_lock);
+	cv_threads_budget = static_cast<int>(count);
+	if (cv_threads_regions == 0)
+		cv::setNumThreads(cv_threads_budget);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& w : workers)
+		w.join();
+	if (global_scheduler == this)
+		global_scheduler = nullptr;
+}
+
+unsigned int TaskScheduler::num_threads() const
+{
+	return static_cast<unsigned int>(workers.size());
+}
+
+void TaskScheduler::submit(std::function<void()> task)
+{
+	// Nobody waits on a submitted task, so its failure can only be logged
+	push([task = std::move(task)]() {
+		try {
+			task();
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Scheduled task failed: " << e.what() << std::endl;
+		}
+		catch (...) {
+			std::cerr << "Scheduled task failed with an unknown exception" << std::endl;
+		}
+	});
+	wake.notify_one();
+}
+
+void TaskScheduler::parallel_for(const size_t begin, const size_t end, const std::function<void(size_t)>& fn, const size_t grain)
+{
+	if (end <= begin)
+		return;
+	const size_t step = std::max<size_t>(grain, 1);
+	const size_t chunks = (end - begin + step - 1) / step;
+	if (chunks == 1) {
+		for (size_t i = begin; i < end; ++i)
+			fn(i);
+		return;
+	}
+
+	// Helpers and the caller claim chunks from a shared counter. The region lives on this stack
+	// frame, which is safe since the call only returns once every helper task has left it, and
+	// keeps each helper task down to one pointer that std::function stores without allocating
+	struct Region {
+		const std::function<void(size_t)>* fn = nullptr;
+		size_t begin = 0;
+		size_t end = 0;
+		size_t step = 1;
+		size_t chunks = 0;
+		std::atomic<size_t> next_chunk{ 0 };
+		std::mutex lock;
+		std::condition_variable done;
+		size_t helpers = 0;
+		std::exception_ptr error;
+
+		void run_chunks() {
+			for (size_t c = next_chunk.fetch_add(1); c < chunks; c = next_chunk.fetch_add(1)) {
+				const size_t chunk_begin = begin + c * step;
+				const size_t chunk_end = std::min(end, chunk_begin + step);
+				try {
+					for (size_t i = chunk_begin; i < chunk_end; ++i)
+						(*fn)(i);
+				}
+				catch (...) {
+					// The first failure is rethrown on the calling thread, the other chunks still run
+					std::lock_guard<std::mutex> guard(lock);
+					if (!error)
+						error = std::current_exception();
+				}
+			}
+		}
+	};
+	Region region;
+	region.fn = &fn;
+	region.begin = begin;
+	region.end = end;
+	region.step = step;
+	region.chunks = chunks;
+	// Helpers start decrementing the count as soon as they are pushed, so the loop uses a copy
+	const size_t helpers = std::min<size_t>(chunks - 1, workers.size());
+	region.helpers = helpers;
+	std::optional<OpenCVThreadsGuard> cv_guard;
+	if (local_owner != this)
+		cv_guard.emplace();
+
+	for (size_t h = 0; h < helpers; ++h) {
+		push([r = &region]() {
+			r->run_chunks();
+			// Notify under the lock, the caller may leave parallel_for as soon as it sees helpers == 0
+			std::lock_guard<std::mutex> guard(r->lock);
+			if (--r->helpers == 0)
+				r->done.notify_all();
+		});
+	}
+	wake.notify_all();
+	region.run_chunks();
+
+	// Every chunk is claimed now. Help out until the helpers are through instead of blocking, this
+	// also keeps nested regions from starving the pool
+	while (true) {
+		{
+			std::lock_guard<std::mutex> guard(region.lock);
+			if (region.helpers == 0)
+				break;
+		}
+		if (try_run_one())
+			continue;
+		std::unique_lock<std::mutex> guard(region.lock);
+		region.done.wait_for(guard, std::chrono::microseconds(200), [&]() { return region.helpers == 0; });
+	}
+	if (region.error)
+		std::rethrow_exception(region.error);
+}
+
+TaskScheduler& TaskScheduler::global()
+{
+	if (global_scheduler)
+		return *global_scheduler;
+	static TaskScheduler fallback;
+	return fallback;
+}
+
+void TaskScheduler::set_global(TaskScheduler* scheduler)
+{
+	global_scheduler = scheduler;
+}
+
+void TaskScheduler::push(std::function<void()> task)
+{
+	size_t index;
+	if (local_owner == this)
+		index = local_index;
+	else
+		index = next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+	{
+		std::lock_guard<std::mutex> guard(queues.at(index)->lock);
+		queues.at(index)->push_back(std::move(task));
+	}
+	std::lock_guard<std::mutex> guard(sleep_lock);
+	pending.fetch_add(1);
+}
+
+bool TaskScheduler::try_run_one()
+{
+	std::function<void()> task;
+	const size_t count = queues.size();
+	const bool is_worker = local_owner == this;
+	const size_t home = is_worker ? local_index : next_queue.load(std::memory_order_relaxed) % count;
+	bool found = false;
+	if (is_worker) {
+		auto& own = *queues.at(home);
+		std::lock_guard<std::mutex> guard(own.lock);
+		found = own.pop_back(task);
+	}
+	for (size_t i = 0; !found && i < count; ++i) {
+		auto& victim = *queues.at((home + i) % count);
+		std::lock_guard<std::mutex> guard(victim.lock);
+		found = victim.pop_front(task);
+	}
+	if (!found)
+		return false;
+	pending.fetch_sub(1);
+	// Every task counts as a scheduler region, whether it came from parallel_for or submit
+	OpenCVThreadsGuard cv_guard;
+	// Never throws, parallel_for chunks hand their exception to the calling thread and submit logs
+	task();
+	return true;
+}
+
+void TaskScheduler::TaskQueue::push_back(std::function<void()> task)
+{
+	if (count == slots.size()) {
+		// Grows in place of allocating per task, the capacity is kept for later bursts
+		std::vector<std::function<void()>> grown(std::max<size_t>(16, slots.size() * 2));
+		for (size_t i = 0; i < count; ++i)
+			grown.at(i) = std::move(slots.at((head + i) % slots.size()));
+		slots.swap(grown);
+		head = 0;
+	}
+	slots.at((head + count) % slots.size()) = std::move(task);
+	++count;
+}
+
+bool TaskScheduler::TaskQueue::pop_back(std::function<void()>& task)
+{
+	if (count == 0)
+		return false;
+	auto& slot = slots.at((head + count - 1) % slots.size());
+	task = std::move(slot);
+	slot = nullptr;
+	--count;
+	return true;
+}
+
+bool TaskScheduler::TaskQueue::pop_front(std::function<void()>& task)
+{
+	if (count == 0)
+		return false;
+	auto& slot = slots.at(head);
+	task = std::move(slot);
+	slot = nullptr;
+	head = (head + 1) % slots.size();
+	--count;
+	return true;
+}
+
+void TaskScheduler::worker_loop(const size_t index)
+{
+	local_owner = this;
+	local_index = index;
+	while (true) {
+		if (try_run_one())
+			continue;
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		wake.wait(guard, [this]() { return stopping || pending.load() > 0; });
+		if (stopping && pending.load() == 0)
+			return;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool shared by all parallel work in the application.
+// Each worker owns a deque, pops its own work LIFO and steals from others FIFO.
+// Threads blocked in parallel_for help execute queued work, so nested calls are safe.
+// Queues only grow and parallel_for keeps its state on the caller's stack, so once the queues
+// have reached their working size, dispatch does not allocate as long as fn is small enough
+// for std::function to store inline (e.g. pass std::ref to a lambda)
+class TaskScheduler {
+public:
+	explicit TaskScheduler(const unsigned int num_threads = 0);
+	~TaskScheduler();
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	unsigned int num_threads() const;
+	void submit(std::function<void()> task);
+	void parallel_for(const size_t begin, const size_t end, const std::function<void(size_t)>& fn, const size_t grain = 1);
+
+	static TaskScheduler& global();
+	static void set_global(TaskScheduler* scheduler);
+
+private:
+	// Ring buffer of tasks, the owner takes from the back and thieves from the front
+	struct TaskQueue {
+		std::mutex lock;
+		std::vector<std::function<void()>> slots;
+		size_t head = 0;
+		size_t count = 0;
+		void push_back(std::function<void()> task);
+		bool pop_back(std::function<void()>& task);
+		bool pop_front(std::function<void()>& task);
+	};
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex sleep_lock;
+	std::condition_variable wake;
+	std::atomic<size_t> pending{ 0 };
+	std::atomic<size_t> next_queue{ 0 };
+	bool stopping = false;
+
+	void push(std::function<void()> task);
+	bool try_run_one();
+	void worker_loop(const size_t index);
+};
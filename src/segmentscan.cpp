@@ -0,0 +1,141 @@
+#include "segmentscan.hpp"
+#include "presence.hpp"
+#include "scheduler.hpp"
+#include "videosource.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+
+namespace {
+	// Start of range i when [first, last] is split evenly into count ranges
+	int even_boundary(const int first, const int last, const int i, const int count)
+	{
+		return first + static_cast<int>(static_cast<long long>(last - first + 1) * i / count);
+	}
+
+	// First keyframe in [from, limit], or 0 if there is none or the backend cannot seek raw packets
+	int find_keyframe_after(const std::string& path, const int from, const int limit)
+	{
+		cv::VideoCapture cap(path, cv::CAP_FFMPEG);
+		if (!cap.isOpened() || !cap.set(cv::CAP_PROP_FORMAT, -1))
+			return 0;
+		if (from > 1 && !cap.set(cv::CAP_PROP_POS_FRAMES, from - 1))
+			return 0;
+		for (int pos = from; pos <= limit && cap.grab(); ++pos) {
+			if (cap.get(cv::CAP_PROP_LRF_HAS_KEY_FRAME) != 0)
+				return pos;
+		}
+		return 0;
+	}
+}
+
+const std::vector<int> find_keyframes(const std::string& path, const int first, const int last, const int count)
+{
+	if (last < first || count < 2)
+		return {};
+	// Only the stretch after each boundary is demuxed, each on its own capture, so long clips are
+	// not read end to end before the segments start
+	std::vector<int> found(static_cast<size_t>(count - 1), 0);
+	TaskScheduler::global().parallel_for(0, found.size(), [&](size_t i) {
+		const int b = static_cast<int>(i) + 1;
+		const int limit = b + 1 < count ? even_boundary(first, last, b + 1, count) - 1 : last;
+		found.at(i) = find_keyframe_after(path, even_boundary(first, last, b, count), limit);
+	});
+	std::vector<int> keyframes;
+	std::copy_if(found.begin(), found.end(), std::back_inserter(keyframes), [](const int k) { return k > 0; });
+	return keyframes;
+}
+
+const std::vector<std::pair<int, int>> plan_segments(const int first, const int last, const int count, const std::vector<int>& keyframes)
+{
+	std::vector<std::pair<int, int>> segments;
+	if (last < first || count < 1)
+		return segments;
+	std::vector<int> starts = { first };
+	for (int i = 1; i < count; ++i) {
+		int start = even_boundary(first, last, i, count);
+		if (!keyframes.empty()) {
+			auto next = std::lower_bound(keyframes.begin(), keyframes.end(), start);
+			int best = next != keyframes.end() ? *next : keyframes.back();
+			if (next != keyframes.begin() && (next == keyframes.end() || start - *(next - 1) < *next - start))
+				best = *(next - 1);
+			start = best;
+		}
+		// Long GOPs can snap several boundaries onto the same keyframe
+		if (start > starts.back() && start <= last)
+			starts.push_back(start);
+	}
+	for (size_t i = 0; i < starts.size(); ++i)
+		segments.emplace_back(starts.at(i), i + 1 < starts.size() ? starts.at(i + 1) - 1 : last);
+	return segments;
+}
+
+const SegmentScanStats run_segment_scan(const SegmentScan& scan, const SegmentDetection& on_detection, const SolveProgress& progress)
+{
+	SegmentScanStats stats;
+	const auto start_time = std::chrono::steady_clock::now();
+	if (scan.last_frame < scan.first_frame || scan.frame_step < 1) {
+		stats.error = "Empty frame range";
+		return stats;
+	}
+	const int count = scan.segments > 0 ? scan.segments : static_cast<int>(TaskScheduler::global().num_threads());
+	const auto keyframes = find_keyframes(scan.video_path, scan.first_frame, scan.last_frame, count);
+	stats.keyframes = static_cast<int>(keyframes.size());
+	const auto segments = plan_segments(scan.first_frame, scan.last_frame, count, keyframes);
+	stats.segments = static_cast<int>(segments.size());
+	const int total = (scan.last_frame - scan.first_frame) / scan.frame_step + 1;
+
+	std::atomic<int> visited{ 0 };
+	std::atomic<int> analysed{ 0 };
+	std::atomic<int> boards{ 0 };
+	std::atomic<int> rejected{ 0 };
+	std::atomic<int> failed{ 0 };
+	std::atomic<bool> canceled{ false };
+	TaskScheduler::global().parallel_for(0, segments.size(), [&](size_t s) {
+		const auto& range = segments.at(s);
+		// First frame of the global step grid inside this segment
+		const int offset = (range.first - scan.first_frame) % scan.frame_step;
+		const int first = offset == 0 ? range.first : range.first + scan.frame_step - offset;
+		if (first > range.second)
+			return;
+		VideoSource video;
+		if (!video.open(scan.video_path, scan.luma_decode)) {
+			++failed;
+			return;
+		}
+		VideoFrame frame;
+		bool success = video.set_pos(first, frame);
+		for (int pos = first; pos <= range.second && !canceled.load(); pos += scan.frame_step) {
+			if (pos > first)
+				success = video.step(scan.frame_step, StepStrategy::grab, frame);
+			// Like the sequential scan, frames that fail to decode are visited but not analysed
+			if (success) {
+				++analysed;
+				if (scan.prefilter && !board_plausible(frame.detection_image(), scan.board_size))
+					++rejected;
+				else {
+					auto corners = get_corners(frame.detection_image(), scan.board_size.width, scan.board_size.height);
+					if (corners.valid) {
+						++boards;
+						on_detection(pos, corners);
+					}
+				}
+			}
+			if (progress && !progress(++visited, total))
+				canceled.store(true);
+		}
+	});
+
+	stats.visited = visited.load();
+	stats.analysed = analysed.load();
+	stats.boards = boards.load();
+	stats.rejected = rejected.load();
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	if (canceled.load())
+		stats.error = "Canceled";
+	else if (failed.load() > 0)
+		stats.error = "Failed to open \"" + scan.video_path + "\" for " + std::to_string(failed.load()) + " segments";
+	stats.success = stats.error.empty();
+	return stats;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "calibration.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+// A scan of one clip split into frame ranges, each decoded by its own capture
+struct SegmentScan {
+	std::string video_path;
+	bool luma_decode = false;
+	int first_frame = 1;
+	int last_frame = 1;
+	int frame_step = 1;
+	cv::Size board_size;
+	// 0 uses one segment per scheduler thread
+	int segments = 0;
+	// Skips frames that fail board_plausible before running the full detector
+	bool prefilter = false;
+};
+
+struct SegmentScanStats {
+	int segments = 0;
+	int keyframes = 0;
+	int visited = 0;
+	int analysed = 0;
+	int boards = 0;
+	int rejected = 0;
+	double seconds = 0.0;
+	std::string error;
+	bool success = false;
+};
+
+// Called from worker threads for every board found
+using SegmentDetection = std::function<void(const int, const ChessboardCorners&)>;
+
+// Keyframe positions (1-based) for splitting [first, last] into count ranges: the first keyframe after
+// each even split, found by seeking there and demuxing packets without decoding them. Boundaries
+// without a keyframe before the next one are left out, empty when the backend cannot hand out raw packets
+const std::vector<int> find_keyframes(const std::string& path, const int first, const int last, const int count);
+
+// Splits [first, last] into at most count ranges, starting each range other than the first on the
+// keyframe closest to an even split. Without keyframes the split is even
+const std::vector<std::pair<int, int>> plan_segments(const int first, const int last, const int count, const std::vector<int>& keyframes);
+
+// Scans the frames first_frame + k * frame_step, the same frames a sequential scan visits, with
+// every segment decoded and searched on its own scheduler thread. Progress counts visited frames,
+// analysed only counts those that decoded
+const SegmentScanStats run_segment_scan(const SegmentScan& scan, const SegmentDetection& on_detection, const SolveProgress& progress = nullptr);
@@ -0,0 +1,130 @@
+#include "stmap.hpp"
+#include "scheduler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// Rows per tile. Tiles are small enough to balance across cores, and each row
+	// warm starts the inverse from its left neighbour
+	constexpr int tile_rows = 16;
+}
+
+const STMap compute_stmap(const CalibrationResult& result, const STMapOptions& options, const SolveProgress& progress)
+{
+	STMap map;
+	if (!result.success)
+		return map;
+	const auto start = Clock::now();
+	const cv::Size plate = options.size.empty() ? result.src_img_size : options.size;
+	const double overscan = std::max(1.0, options.overscan);
+	const cv::Size wide(static_cast<int>(std::lround(plate.width * overscan)), static_cast<int>(std::lround(plate.height * overscan)));
+	const cv::Point2d margin((wide.width - plate.width) * 0.5, (wide.height - plate.height) * 0.5);
+	const bool redistort = options.direction == STMapDirection::redistort;
+
+	// Intrinsics at plate resolution, the undistorted image shares them shifted by the overscan margin
+	const cv::Matx33d K = result.scaled_K(plate);
+	const double fx = K(0, 0), fy = K(1, 1), cx = K(0, 2), cy = K(1, 2), skew = K(0, 1);
+	auto to_normalized = [&](const double u, const double v) {
+		const double y = (v - cy) / fy;
+		return cv::Point2d((u - cx - skew * y) / fx, y);
+	};
+	auto to_pixel = [&](const cv::Point2d& p) {
+		return cv::Point2d(fx * p.x + skew * p.y + cx, fy * p.y + cy);
+	};
+
+	const cv::Size out_size = redistort ? plate : wide;
+	const cv::Size sample_size = redistort ? wide : plate;
+	const cv::Point2d out_offset = redistort ? cv::Point2d() : margin;
+	const cv::Point2d sample_offset = redistort ? margin : cv::Point2d();
+	map.st.create(out_size, CV_32FC2);
+
+	const Kk& cam_Kk = result.cam_Kk;
+	const int tiles = (out_size.height + tile_rows - 1) / tile_rows;
+	std::atomic<int> unconverged{ 0 };
+	std::atomic<int> tiles_done{ 0 };
+	std::atomic<bool> canceled{ false };
+	TaskScheduler::global().parallel_for(0, static_cast<size_t>(tiles), [&](size_t tile) {
+		if (canceled.load())
+			return;
+		int failed = 0;
+		const int row_end = std::min(out_size.height, static_cast<int>(tile + 1) * tile_rows);
+		for (int v = static_cast<int>(tile) * tile_rows; v < row_end; ++v) {
+			auto* row = map.st.ptr<cv::Vec2f>(v);
+			cv::Point2d guess;
+			bool have_guess = false;
+			for (int u = 0; u < out_size.width; ++u) {
+				const cv::Point2d p = to_normalized(u - out_offset.x, v - out_offset.y);
+				cv::Point2d q;
+				if (!redistort)
+					q = cam_Kk.distort_point(p);
+				else {
+					bool ok = cam_Kk.undistort_point(p, have_guess ? guess : p, q, options.max_iter);
+					if (!ok && have_guess)
+						ok = cam_Kk.undistort_point(p, p, q, options.max_iter);
+					have_guess = ok;
+					if (!ok) {
+						row[u] = cv::Vec2f(-1.0f, -1.0f);
+						++failed;
+						continue;
+					}
+					guess = q;
+				}
+				const cv::Point2d s = to_pixel(q) + sample_offset;
+				row[u] = cv::Vec2f(static_cast<float>((s.x + 0.5) / sample_size.width), static_cast<float>(1.0 - (s.y + 0.5) / sample_size.height));
+			}
+		}
+		unconverged += failed;
+		if (progress && !progress(++tiles_done, tiles))
+			canceled.store(true);
+	});
+	if (canceled.load())
+		return STMap();
+	map.unconverged = unconverged.load();
+	map.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return map;
+}
+
+bool write_stmap(const STMap& map, const std::string& path, std::string& error)
+{
+	if (map.st.empty()) {
+		error = "Empty map";
+		return false;
+	}
+	std::string ext = std::filesystem::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	std::vector<cv::Mat> st;
+	cv::split(map.st, st);
+	cv::Mat bgr;
+	cv::merge(std::vector<cv::Mat>{ cv::Mat::zeros(map.st.size(), CV_32FC1), st.at(1), st.at(0) }, bgr);
+	std::vector<int> params;
+	if (ext == ".png") {
+		// Saturating conversion clamps samples outside the plate to its edges
+		bgr.convertTo(bgr, CV_16UC3, 65535.0);
+		params = { cv::IMWRITE_PNG_COMPRESSION, 1 };
+	}
+	else if (ext == ".exr") {
+		// Needs OPENCV_IO_ENABLE_OPENEXR, which main() sets before any thread starts
+		params = { cv::IMWRITE_EXR_TYPE, cv::IMWRITE_EXR_TYPE_FLOAT };
+	}
+	else if (ext != ".tif" && ext != ".tiff") {
+		error = "Unsupported format \"" + ext + "\", use .png, .tif or .exr";
+		return false;
+	}
+	try {
+		if (!cv::imwrite(path, bgr, params)) {
+			error = "Failed writing to \"" + path + "\"";
+			return false;
+		}
+	}
+	catch (const cv::Exception& e) {
+		error = e.what();
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "calibration.hpp"
+#include <string>
+
+// An undistort map turns the plate into an undistorted image, a redistort map puts the
+// distortion back onto an undistorted (possibly overscanned) render
+enum class STMapDirection {
+	undistort,
+	redistort
+};
+
+struct STMapOptions {
+	STMapDirection direction = STMapDirection::undistort;
+	// Plate resolution, empty means the resolution the solution was calibrated at
+	cv::Size size;
+	// Size of the undistorted image relative to the plate
+	double overscan = 1.0;
+	int max_iter = 20;
+};
+
+// Normalized (s, t) sample positions per output pixel, t pointing up as compositing packages expect.
+// Pixels the inverse could not be solved for hold (-1, -1)
+struct STMap {
+	cv::Mat st;
+	int unconverged = 0;
+	double seconds = 0.0;
+};
+
+const STMap compute_stmap(const CalibrationResult& result, const STMapOptions& options, const SolveProgress& progress = nullptr);
+
+// The format follows the extension: .png is written as 16-bit, .tif/.tiff and .exr as 32-bit float.
+// Channels are R = s, G = t, B = 0
+bool write_stmap(const STMap& map, const std::string& path, std::string& error);
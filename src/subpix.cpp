@@ -0,0 +1,263 @@
+#include "subpix.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+	constexpr int max_kernel_half = 32;
+
+	// Gaussian weights and column offsets for one window size, rows padded to whole vectors
+	// with zero weights so the accumulation loop never needs a scalar tail
+	struct WindowKernel {
+		int half = 0;
+		int width = 0;
+		int padded = 0;
+		std::vector<float> mask;
+		std::vector<float> px;
+	};
+
+	const WindowKernel& window_kernel(const int half)
+	{
+		static const std::vector<WindowKernel> kernels = []() {
+			std::vector<WindowKernel> out(max_kernel_half + 1);
+			for (int h = 1; h <= max_kernel_half; ++h) {
+				auto& k = out.at(h);
+				k.half = h;
+				k.width = 2 * h + 1;
+				k.padded = (k.width + 7) / 8 * 8;
+				k.mask.assign(static_cast<size_t>(k.width * k.padded), 0.0f);
+				k.px.assign(static_cast<size_t>(k.padded), 0.0f);
+				for (int j = 0; j < k.width; ++j)
+					k.px.at(j) = static_cast<float>(j - h);
+				for (int i = 0; i < k.width; ++i) {
+					const double y = static_cast<double>(i - h) / h;
+					for (int j = 0; j < k.width; ++j) {
+						const double x = static_cast<double>(j - h) / h;
+						k.mask.at(static_cast<size_t>(i * k.padded + j)) = static_cast<float>(std::exp(-x * x) * std::exp(-y * y));
+					}
+				}
+			}
+			return out;
+		}();
+		return kernels.at(std::clamp(half, 1, max_kernel_half));
+	}
+
+	// Bilinear sample of a size x size patch centred on a subpixel position, replicating the border
+	void extract_patch(const cv::Mat& gray, const cv::Point2f& center, const int size, float* out)
+	{
+		const float x0 = center.x - (size - 1) * 0.5f;
+		const float y0 = center.y - (size - 1) * 0.5f;
+		const int ix = cvFloor(x0);
+		const int iy = cvFloor(y0);
+		const float fx = x0 - ix;
+		const float fy = y0 - iy;
+		const float w00 = (1.0f - fx) * (1.0f - fy);
+		const float w01 = fx * (1.0f - fy);
+		const float w10 = (1.0f - fx) * fy;
+		const float w11 = fx * fy;
+		if (ix >= 0 && iy >= 0 && ix + size < gray.cols && iy + size < gray.rows) {
+			for (int i = 0; i < size; ++i) {
+				const uchar* r0 = gray.ptr<uchar>(iy + i) + ix;
+				const uchar* r1 = gray.ptr<uchar>(iy + i + 1) + ix;
+				float* dst = out + i * size;
+				for (int j = 0; j < size; ++j)
+					dst[j] = w00 * r0[j] + w01 * r0[j + 1] + w10 * r1[j] + w11 * r1[j + 1];
+			}
+			return;
+		}
+		auto clamp_x = [&](int x) { return std::clamp(x, 0, gray.cols - 1); };
+		auto clamp_y = [&](int y) { return std::clamp(y, 0, gray.rows - 1); };
+		for (int i = 0; i < size; ++i) {
+			const uchar* r0 = gray.ptr<uchar>(clamp_y(iy + i));
+			const uchar* r1 = gray.ptr<uchar>(clamp_y(iy + i + 1));
+			float* dst = out + i * size;
+			for (int j = 0; j < size; ++j) {
+				const int xa = clamp_x(ix + j);
+				const int xb = clamp_x(ix + j + 1);
+				dst[j] = w00 * r0[xa] + w01 * r0[xb] + w10 * r1[xa] + w11 * r1[xb];
+			}
+		}
+	}
+
+	struct Moments {
+		double a = 0, b = 0, c = 0, bb1 = 0, bb2 = 0;
+	};
+
+#if defined(__AVX2__)
+	inline float hsum(const __m256 v)
+	{
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+		return _mm_cvtss_f32(s);
+	}
+#endif
+
+	// Gradient structure tensor and its first moments over the window. Sums run in float
+	// within a row and are carried across rows in double
+	Moments accumulate(const float* patch, const int stride, const WindowKernel& k)
+	{
+		Moments m;
+		for (int i = 0; i < k.width; ++i) {
+			const float* row = patch + (i + 1) * stride + 1;
+			const float* up = row - stride;
+			const float* down = row + stride;
+			const float* mrow = k.mask.data() + i * k.padded;
+			const double py = static_cast<double>(i - k.half);
+			float ra, rb, rc, rxx, rxy;
+#if defined(__AVX2__)
+			__m256 va = _mm256_setzero_ps(), vb = va, vc = va, vxx = va, vxy = va;
+			for (int j = 0; j < k.padded; j += 8) {
+				const __m256 gx = _mm256_sub_ps(_mm256_loadu_ps(row + j + 1), _mm256_loadu_ps(row + j - 1));
+				const __m256 gy = _mm256_sub_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+				const __m256 mk = _mm256_loadu_ps(mrow + j);
+				const __m256 px = _mm256_loadu_ps(k.px.data() + j);
+				const __m256 gxm = _mm256_mul_ps(gx, mk);
+				const __m256 gxx = _mm256_mul_ps(gxm, gx);
+				const __m256 gxy = _mm256_mul_ps(gxm, gy);
+				const __m256 gyy = _mm256_mul_ps(_mm256_mul_ps(gy, mk), gy);
+				va = _mm256_add_ps(va, gxx);
+				vb = _mm256_add_ps(vb, gxy);
+				vc = _mm256_add_ps(vc, gyy);
+				vxx = _mm256_add_ps(vxx, _mm256_mul_ps(gxx, px));
+				vxy = _mm256_add_ps(vxy, _mm256_mul_ps(gxy, px));
+			}
+			ra = hsum(va);
+			rb = hsum(vb);
+			rc = hsum(vc);
+			rxx = hsum(vxx);
+			rxy = hsum(vxy);
+#else
+			ra = rb = rc = rxx = rxy = 0.0f;
+			for (int j = 0; j < k.width; ++j) {
+				const float gx = row[j + 1] - row[j - 1];
+				const float gy = down[j] - up[j];
+				const float gxx = gx * gx * mrow[j];
+				const float gxy = gx * gy * mrow[j];
+				const float gyy = gy * gy * mrow[j];
+				ra += gxx;
+				rb += gxy;
+				rc += gyy;
+				rxx += gxx * k.px[j];
+				rxy += gxy * k.px[j];
+			}
+#endif
+			m.a += ra;
+			m.b += rb;
+			m.c += rc;
+			m.bb1 += rxx + py * rb;
+			m.bb2 += rxy + py * rc;
+		}
+		return m;
+	}
+}
+
+const int SubpixReport::num_converged() const
+{
+	return static_cast<int>(std::count(converged.begin(), converged.end(), 1));
+}
+
+const std::vector<int> adaptive_window_halves(const std::vector<cv::Point2f>& corners, const cv::Size& board_size,
+	const int min_half, const int max_half)
+{
+	std::vector<int> halves(corners.size(), max_half);
+	const int width = board_size.width;
+	const int height = board_size.height;
+	if (static_cast<int>(corners.size()) < board_size.area())
+		return halves;
+	for (int r = 0; r < height; ++r) {
+		for (int c = 0; c < width; ++c) {
+			const size_t idx = static_cast<size_t>(r * width + c);
+			const auto& p = corners.at(idx);
+			double spacing = std::numeric_limits<double>::infinity();
+			auto consider = [&](int nr, int nc) {
+				if (nr < 0 || nc < 0 || nr >= height || nc >= width)
+					return;
+				spacing = std::min(spacing, cv::norm(p - corners.at(static_cast<size_t>(nr * width + nc))));
+			};
+			consider(r - 1, c);
+			consider(r + 1, c);
+			consider(r, c - 1);
+			consider(r, c + 1);
+			// Parallel grid lines one square away must stay outside the window, with margin for blur
+			if (std::isfinite(spacing))
+				halves.at(idx) = std::clamp(static_cast<int>(spacing * 0.4), min_half, max_half);
+		}
+	}
+	return halves;
+}
+
+void refine_corners(const cv::Mat& gray, std::vector<cv::Point2f>& corners, const cv::Size& board_size,
+	SubpixReport* report, const int max_iter, const double eps)
+{
+	CV_Assert(gray.type() == CV_8UC1);
+	const size_t n = corners.size();
+	const auto halves = adaptive_window_halves(corners, board_size);
+	const std::vector<cv::Point2f> initial = corners;
+	std::vector<uchar> active(n, 1);
+	std::vector<uchar> converged(n, 0);
+	std::vector<int> iterations(n, 0);
+	std::vector<float> shift(n, 0.0f);
+
+	// One scratch patch sized for the largest window, padded for full vector loads past the row end
+	const int max_half = halves.empty() ? 1 : *std::max_element(halves.begin(), halves.end());
+	const int max_patch = 2 * max_half + 3;
+	thread_local std::vector<float> patch;
+	patch.assign(static_cast<size_t>(max_patch * max_patch + 16), 0.0f);
+
+	const double eps2 = eps * eps;
+	size_t remaining = n;
+	for (int iter = 0; iter < max_iter && remaining > 0; ++iter) {
+		for (size_t p = 0; p < n; ++p) {
+			if (!active.at(p))
+				continue;
+			const auto& k = window_kernel(halves.at(p));
+			const int size = k.width + 2;
+			extract_patch(gray, corners.at(p), size, patch.data());
+			const Moments m = accumulate(patch.data(), size, k);
+			const double det = m.a * m.c - m.b * m.b;
+			if (std::fabs(det) <= DBL_EPSILON * DBL_EPSILON) {
+				active.at(p) = 0;
+				--remaining;
+				continue;
+			}
+			const double scale = 1.0 / det;
+			const cv::Point2f next(
+				static_cast<float>(corners.at(p).x + m.c * scale * m.bb1 - m.b * scale * m.bb2),
+				static_cast<float>(corners.at(p).y - m.b * scale * m.bb1 + m.a * scale * m.bb2));
+			const double err = (next.x - corners.at(p).x) * (next.x - corners.at(p).x)
+				+ (next.y - corners.at(p).y) * (next.y - corners.at(p).y);
+			corners.at(p) = next;
+			shift.at(p) = static_cast<float>(std::sqrt(err));
+			++iterations.at(p);
+			if (next.x < 0 || next.y < 0 || next.x >= gray.cols || next.y >= gray.rows) {
+				active.at(p) = 0;
+				--remaining;
+			}
+			else if (err <= eps2) {
+				converged.at(p) = 1;
+				active.at(p) = 0;
+				--remaining;
+			}
+		}
+	}
+
+	// Same safeguard as cornerSubPix: a corner that wandered out of its window is left unrefined
+	for (size_t p = 0; p < n; ++p) {
+		const auto d = corners.at(p) - initial.at(p);
+		if (std::fabs(d.x) > halves.at(p) || std::fabs(d.y) > halves.at(p)) {
+			corners.at(p) = initial.at(p);
+			converged.at(p) = 0;
+		}
+	}
+
+	if (report) {
+		report->window_halves = halves;
+		report->iterations = iterations;
+		report->final_shift = shift;
+		report->converged = converged;
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+struct SubpixReport {
+	std::vector<int> window_halves;
+	std::vector<int> iterations;
+	std::vector<float> final_shift;
+	std::vector<uchar> converged;
+	const int num_converged() const;
+};
+
+// Half window size per corner, derived from the distance to its nearest grid neighbours
+// so that the window never reaches into the adjacent squares
+const std::vector<int> adaptive_window_halves(const std::vector<cv::Point2f>& corners, const cv::Size& board_size,
+	const int min_half = 2, const int max_half = 11);
+
+// Refines all corners of a board in one batched pass, equivalent to cv::cornerSubPix
+// but with per-corner window sizes and vectorized gradient accumulation
+void refine_corners(const cv::Mat& gray, std::vector<cv::Point2f>& corners, const cv::Size& board_size,
+	SubpixReport* report = nullptr, const int max_iter = 30, const double eps = 0.001);
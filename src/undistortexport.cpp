@@ -0,0 +1,248 @@
+#include "undistortexport.hpp"
+#include "scheduler.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	struct Batch {
+		std::vector<cv::Mat> frames;
+		std::vector<cv::Mat> undistorted;
+		size_t count = 0;
+	};
+
+	// Hands batches between pipeline stages. Items left in a closed queue are still handed out
+	class BatchQueue {
+	public:
+		void push(Batch* batch) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				batches.push_back(batch);
+			}
+			ready.notify_one();
+		}
+
+		Batch* pop() {
+			std::unique_lock<std::mutex> guard(lock);
+			ready.wait(guard, [&]() { return closed || !batches.empty(); });
+			if (batches.empty())
+				return nullptr;
+			Batch* batch = batches.front();
+			batches.pop_front();
+			return batch;
+		}
+
+		void close() {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				closed = true;
+			}
+			ready.notify_all();
+		}
+
+	private:
+		std::mutex lock;
+		std::condition_variable ready;
+		std::deque<Batch*> batches;
+		bool closed = false;
+	};
+
+	// Encoders for 4:2:0 formats reject odd dimensions
+	const cv::Size scaled_size(const cv::Size& size, const double scale)
+	{
+		auto even = [](const double v) { return std::max(2, 2 * static_cast<int>(std::lround(v / 2))); };
+		return cv::Size(even(size.width * scale), even(size.height * scale));
+	}
+
+	bool export_clip(const CalibrationResult& result, const std::string& input, const std::string& output,
+		const UndistortExportOptions& options, std::atomic<bool>& canceled, const std::function<void(const int)>& on_frames, std::string& error)
+	{
+		cv::VideoCapture cap(input);
+		if (!cap.isOpened()) {
+			error = "Failed to open \"" + input + "\"";
+			return false;
+		}
+		const cv::Size src_size(static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT)));
+		const cv::Size dst_size = scaled_size(src_size, options.scale);
+		double fps = cap.get(cv::CAP_PROP_FPS);
+		if (!(fps > 0))
+			fps = 30.0;
+
+		// Keep the input codec where the backend can encode it
+		cv::VideoWriter writer(output, static_cast<int>(cap.get(cv::CAP_PROP_FOURCC)), fps, dst_size, true);
+		if (!writer.isOpened())
+			writer.open(output, cv::VideoWriter::fourcc('m', 'p', '4', 'v'), fps, dst_size, true);
+		if (!writer.isOpened()) {
+			error = "Failed to open \"" + output + "\" for writing";
+			return false;
+		}
+
+		// Fixed-point maps halve the memory traffic of float maps and are computed once per clip
+		cv::Mat map_a, map_b;
+		result.undistort_maps(src_size, dst_size, map_a, map_b);
+
+		// Three batches circulate: one decoding, one remapping, one encoding
+		const size_t batch_frames = options.batch_frames > 0 ? options.batch_frames : std::max<size_t>(1, TaskScheduler::global().num_threads() * 2);
+		std::vector<Batch> batches(3);
+		BatchQueue free_batches, decoded, remapped;
+		for (auto& b : batches) {
+			b.frames.resize(batch_frames);
+			b.undistorted.resize(batch_frames);
+			free_batches.push(&b);
+		}
+
+		std::thread decoder([&]() {
+			while (Batch* batch = free_batches.pop()) {
+				if (canceled.load())
+					break;
+				batch->count = 0;
+				while (batch->count < batch->frames.size() && cap.read(batch->frames.at(batch->count)))
+					++batch->count;
+				const bool done = batch->count < batch->frames.size();
+				if (batch->count > 0)
+					decoded.push(batch);
+				if (done)
+					break;
+			}
+			decoded.close();
+		});
+		// VideoWriter::write does not report failures, so the writer is checked after every batch and
+		// the finished file is read back below
+		std::string write_error;
+		int written = 0;
+		std::thread encoder([&]() {
+			while (Batch* batch = remapped.pop()) {
+				if (!canceled.load()) {
+					try {
+						for (size_t i = 0; i < batch->count; ++i)
+							writer.write(batch->undistorted.at(i));
+						written += static_cast<int>(batch->count);
+						if (!writer.isOpened())
+							write_error = "Writing \"" + output + "\" failed";
+					}
+					catch (const cv::Exception& e) {
+						write_error = "Writing \"" + output + "\" failed: " + e.what();
+					}
+					if (!write_error.empty())
+						canceled.store(true);
+					else
+						on_frames(static_cast<int>(batch->count));
+				}
+				free_batches.push(batch);
+			}
+		});
+
+		while (Batch* batch = decoded.pop()) {
+			if (!canceled.load()) {
+				try {
+					TaskScheduler::global().parallel_for(0, batch->count, [&](size_t i) {
+						cv::remap(batch->frames.at(i), batch->undistorted.at(i), map_a, map_b, options.interpolation, cv::BORDER_CONSTANT);
+					});
+				}
+				catch (const cv::Exception& e) {
+					error = e.what();
+					canceled.store(true);
+				}
+			}
+			remapped.push(batch);
+		}
+		remapped.close();
+		decoder.join();
+		encoder.join();
+		writer.release();
+		if (!write_error.empty() && error.empty())
+			error = write_error;
+		if (!canceled.load()) {
+			// A full disk or a failing encoder leaves a short file behind. Containers may only
+			// estimate their frame count, so a frame of slack is allowed
+			cv::VideoCapture check(output);
+			const int frames = check.isOpened() ? static_cast<int>(check.get(cv::CAP_PROP_FRAME_COUNT)) : 0;
+			if (frames < written - std::max(1, written / 100)) {
+				error = "Only " + std::to_string(std::max(0, frames)) + " of " + std::to_string(written) + " frames were written to \"" + output + "\"";
+				canceled.store(true);
+			}
+		}
+		if (canceled.load()) {
+			std::error_code ec;
+			std::filesystem::remove(output, ec);
+			return false;
+		}
+		return true;
+	}
+}
+
+const std::string undistorted_path(const std::string& input, const std::string& output_dir)
+{
+	const std::filesystem::path in(input);
+	return (std::filesystem::path(output_dir) / (in.stem().string() + "_undistorted" + in.extension().string())).string();
+}
+
+const std::vector<std::string> undistorted_paths(const std::vector<std::string>& inputs, const std::string& output_dir)
+{
+	// Inputs from different folders can share a stem, later ones get a numbered suffix
+	std::vector<std::string> outputs;
+	std::set<std::filesystem::path> taken;
+	for (auto& input : inputs)
+		taken.insert(std::filesystem::absolute(input).lexically_normal());
+	for (auto& input : inputs) {
+		const std::filesystem::path in(input);
+		std::filesystem::path out = undistorted_path(input, output_dir);
+		for (int n = 2; taken.count(std::filesystem::absolute(out).lexically_normal()) > 0; ++n)
+			out = std::filesystem::path(output_dir) / (in.stem().string() + "_undistorted_" + std::to_string(n) + in.extension().string());
+		taken.insert(std::filesystem::absolute(out).lexically_normal());
+		outputs.push_back(out.string());
+	}
+	return outputs;
+}
+
+const UndistortExportStats export_undistorted(const CalibrationResult& result, const std::vector<std::pair<std::string, std::string>>& clips,
+	const UndistortExportOptions& options, const SolveProgress& progress)
+{
+	UndistortExportStats stats;
+	if (!result.success) {
+		stats.error = "No solution to undistort with";
+		return stats;
+	}
+	// A clip must neither overwrite an input nor the output of another clip in the batch
+	std::set<std::filesystem::path> inputs, outputs;
+	for (auto& clip : clips)
+		inputs.insert(std::filesystem::absolute(clip.first).lexically_normal());
+	for (auto& clip : clips) {
+		const auto out = std::filesystem::absolute(clip.second).lexically_normal();
+		if (inputs.count(out) > 0 || !outputs.insert(out).second) {
+			stats.error = "Output \"" + clip.second + "\" is used more than once in the batch";
+			return stats;
+		}
+	}
+	int total = 0;
+	for (auto& clip : clips) {
+		cv::VideoCapture cap(clip.first);
+		total += std::max(0, static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT)));
+	}
+
+	const auto start = Clock::now();
+	std::atomic<bool> canceled{ false };
+	auto on_frames = [&](const int count) {
+		stats.frames += count;
+		if (progress && !progress(stats.frames, std::max(total, stats.frames)))
+			canceled.store(true);
+	};
+	for (auto& clip : clips) {
+		if (!export_clip(result, clip.first, clip.second, options, canceled, on_frames, stats.error)) {
+			if (stats.error.empty())
+				stats.error = "Canceled";
+			break;
+		}
+		++stats.clips;
+	}
+	stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	stats.success = stats.clips == static_cast<int>(clips.size());
+	return stats;
+}
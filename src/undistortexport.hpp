@@ -0,0 +1,34 @@
+#pragma once
+
+#include "calibration.hpp"
+#include <string>
+#include <vector>
+
+struct UndistortExportOptions {
+	double scale = 1.0;
+	int interpolation = cv::INTER_LINEAR;
+	// Frames per remap batch, 0 sizes batches from the scheduler's thread count
+	int batch_frames = 0;
+};
+
+struct UndistortExportStats {
+	int clips = 0;
+	int frames = 0;
+	double seconds = 0.0;
+	std::string error;
+	bool success = false;
+};
+
+// Output path for a clip exported into a directory, keeping the container of the input
+const std::string undistorted_path(const std::string& input, const std::string& output_dir);
+
+// Output paths for a batch exported into one directory, numbered where inputs share a name
+const std::vector<std::string> undistorted_paths(const std::vector<std::string>& inputs, const std::string& output_dir);
+
+// Writes undistorted copies of whole clips. Decoding, remapping and encoding run as a pipeline:
+// one thread decodes batches of frames, the scheduler remaps each batch with precomputed
+// fixed-point maps and another thread encodes them in order. Progress counts frames over all clips.
+// Batches whose outputs collide with each other or with an input are refused, and a clip fails
+// if its encoder stops or the written file comes up short
+const UndistortExportStats export_undistorted(const CalibrationResult& result, const std::vector<std::pair<std::string, std::string>>& clips,
+	const UndistortExportOptions& options, const SolveProgress& progress = nullptr);
@@ -0,0 +1,130 @@
+#include "videosource.hpp"
+
+const char* step_strategy_name(const StepStrategy strategy)
+{
+	switch (strategy) {
+	case StepStrategy::grab:
+		return "grab";
+	case StepStrategy::seek:
+		return "seek";
+	default:
+		return "read";
+	}
+}
+
+bool VideoSource::open(const std::string& path, const bool luma_decode)
+{
+	cv::VideoCapture new_cap;
+	new_cap.open(path);
+	if (!new_cap.isOpened())
+		return false;
+	cap.release();
+	cap = new_cap;
+	file = path;
+	luma = luma_decode;
+	failed = 0;
+	reopens = 0;
+	::set_luma_decode(cap, luma);
+	return true;
+}
+
+void VideoSource::release()
+{
+	cap.release();
+	file.clear();
+}
+
+const bool VideoSource::is_open() const
+{
+	return cap.isOpened();
+}
+
+const std::string& VideoSource::path() const
+{
+	return file;
+}
+
+const cv::Size VideoSource::frame_size() const
+{
+	if (!cap.isOpened())
+		return cv::Size();
+	return cv::Size(static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH)), static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+bool VideoSource::set_luma_decode(const bool enable)
+{
+	luma = enable;
+	return ::set_luma_decode(cap, luma);
+}
+
+const int VideoSource::current_pos() const
+{
+	if (!cap.isOpened())
+		return 0;
+	return static_cast<int>(cap.get(cv::CAP_PROP_POS_FRAMES));
+}
+
+const int VideoSource::total_frames() const
+{
+	if (!cap.isOpened())
+		return 0;
+	return static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+}
+
+bool VideoSource::set_pos(const int pos, VideoFrame& frame)
+{
+	failed = 0;
+	if (!cap.isOpened())
+		return false;
+	int current_pos = this->current_pos();
+	if (pos < 1 || pos > total_frames())
+		return false;
+	if (pos - current_pos != 1 && !cap.set(cv::CAP_PROP_POS_FRAMES, pos - 1))
+		return false;
+	bool success = read_frame(cap, frame);
+	for (int i = 0; i < read_retries && !success; ++i)
+		success = read_frame(cap, frame);
+	if (!success) {
+		failed = pos;
+		cv::VideoCapture new_cap;
+		new_cap.open(file);
+		cap = new_cap;
+		::set_luma_decode(cap, luma);
+		cap.set(cv::CAP_PROP_POS_FRAMES, current_pos);
+		++reopens;
+		return false;
+	}
+	return true;
+}
+
+bool VideoSource::step(const int count, const StepStrategy strategy, VideoFrame& frame)
+{
+	const int target = current_pos() + count;
+	switch (strategy) {
+	case StepStrategy::grab:
+		// A failed grab falls back to a seek, which carries the full recovery path
+		for (int i = 1; i < count; ++i) {
+			if (!cap.grab())
+				return set_pos(target, frame);
+		}
+		return set_pos(target, frame);
+	case StepStrategy::seek:
+		return set_pos(target, frame);
+	default:
+		for (int i = 1; i < count; ++i) {
+			if (!set_pos(current_pos() + 1, frame))
+				return false;
+		}
+		return set_pos(target, frame);
+	}
+}
+
+const int VideoSource::failed_frame() const
+{
+	return failed;
+}
+
+const int VideoSource::reopen_count() const
+{
+	return reopens;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "frame.hpp"
+#include <string>
+
+// How a scan moves past the frames it does not analyse
+enum class StepStrategy {
+	read,   // Decode and retrieve every frame in between
+	grab,   // Decode frames in between without retrieving them
+	seek    // Seek straight to the next analysed frame
+};
+
+const char* step_strategy_name(const StepStrategy strategy);
+
+// File backed capture with the read recovery the editor relies on. Positions are 1-based
+// and name the frame that was read last, matching CAP_PROP_POS_FRAMES after a read
+class VideoSource {
+public:
+	bool open(const std::string& path, const bool luma_decode);
+	void release();
+	const bool is_open() const;
+	const std::string& path() const;
+	const cv::Size frame_size() const;
+	// Returns false when the backend ignores the request and keeps converting to BGR
+	bool set_luma_decode(const bool enable);
+	const int current_pos() const;
+	const int total_frames() const;
+	// Reads frame pos. Transient read failures are retried, a decoder that stays stuck is
+	// reopened at the previous position and the frame number is kept in failed_frame()
+	bool set_pos(const int pos, VideoFrame& frame);
+	// Moves count frames forward and reads the frame landed on
+	bool step(const int count, const StepStrategy strategy, VideoFrame& frame);
+	const int failed_frame() const;
+	const int reopen_count() const;
+
+private:
+	static constexpr int read_retries = 100;
+	cv::VideoCapture cap;
+	std::string file;
+	bool luma = false;
+	int failed = 0;
+	int reopens = 0;
+};
@@ -1,17 +1,30 @@
 #include "window.h"
 #include "ui_window.h"
+#include "scheduler.hpp"
+#include "distributed.hpp"
+#include "undistortexport.hpp"
+#include "stmap.hpp"
+#include "segmentscan.hpp"
+#include "presence.hpp"
+#include "convergence.hpp"
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QDropEvent>
 #include <QMimeData>
+#include <QMouseEvent>
 #include <QUrl>
 #include <QList>
 #include <QMovie> 
 #include <QProgressDialog>
+#include <QInputDialog>
 #include <QtConcurrent/QtConcurrent>
 #include <filesystem>
 #include <fstream>
 #include <future>
+#include <mutex>
 #include <chrono>
+#include <thread>
+#include <iomanip>
 
 using namespace std::chrono_literals;
 
@@ -22,6 +35,7 @@ window::window(QWidget *parent)
     , orig_playback_tooltip("Drag and drop into this window\nOr go to File > Open")
 {
     ui->setupUi(this);
+    ui->segments_num->setValue(static_cast<int>(TaskScheduler::global().num_threads()));
 
     // Startup state changes
     reset_results_display();
@@ -41,7 +55,13 @@ window::window(QWidget *parent)
     connect(ui->sensor_width_edit, &QDoubleSpinBox::valueChanged, this, &window::update_focal_length);
     connect(ui->board_width_edit, &QSpinBox::valueChanged, this, &window::update_board_display);
     connect(ui->board_height_edit, &QSpinBox::valueChanged, this, &window::update_board_display);
+    connect(ui->board_width_edit, &QSpinBox::valueChanged, this, &window::update_live_board_size);
+    connect(ui->board_height_edit, &QSpinBox::valueChanged, this, &window::update_live_board_size);
+    connect(&live_timer, &QTimer::timeout, this, &window::on_live_tick);
     connect(ui->auto_detect_button, &QPushButton::released, this, &window::auto_detect_boards);
+    connect(&solve_watcher, &QFutureWatcher<CalibrationResult>::finished, this, &window::on_solve_finished);
+    connect(ui->bootstrap_button, &QPushButton::released, this, &window::run_bootstrap);
+    connect(&bootstrap_watcher, &QFutureWatcher<BootstrapResult>::finished, this, &window::on_bootstrap_finished);
 
     // Edit behavior fixes
     connect(ui->board_width_edit, &QSpinBox::editingFinished, this, &window::clear_edit_focus);
@@ -51,6 +71,10 @@ window::window(QWidget *parent)
 
     // Action mappings
     connect(ui->actionOpen, &QAction::triggered, this, &window::open_file);
+    connect(ui->actionOpen_live, &QAction::triggered, this, &window::open_live_source);
+    connect(ui->actionExport_undistorted, &QAction::triggered, this, &window::export_undistorted_clip);
+    connect(ui->actionExport_undistorted_batch, &QAction::triggered, this, &window::export_undistorted_batch);
+    connect(ui->actionExport_stmaps, &QAction::triggered, this, &window::export_stmaps);
     connect(ui->actionNext_frame, &QAction::triggered, this, &window::next_frame);
     connect(ui->actionPrevious_frame, &QAction::triggered, this, &window::prev_frame);
     connect(ui->actionDetect_board_on_current_frame, &QAction::triggered, this, &window::detect_board);
@@ -59,12 +83,21 @@ window::window(QWidget *parent)
     connect(ui->actionJump_to_beginning, &QAction::triggered, this, &window::to_beginning);
     connect(ui->actionJump_to_end, &QAction::triggered, this, &window::to_end);
     connect(ui->actionToggle_playback, &QAction::triggered, this, &window::play_toggle);
+    connect(ui->actionLuma_decode, &QAction::toggled, this, &window::toggle_luma_decode);
+    connect(ui->actionCoverage_gaps, &QAction::toggled, this, &window::toggle_coverage_gaps);
+    ui->playback_display->installEventFilter(this);
+    connect(ui->actionDistributed_detect, &QAction::triggered, this, &window::distributed_detect_boards);
 
     status_info("Ready.");
 }
 
 window::~window()
 {
+    stop_live();
+    cancel_solve();
+    cancel_bootstrap();
+    solve_watcher.waitForFinished();
+    bootstrap_watcher.waitForFinished();
     close_board_display();
     delete ui;
 }
@@ -98,19 +131,120 @@ void window::closeEvent(QCloseEvent* event)
 
 void window::attempt_video_load(std::string path)
 {
-    cv::VideoCapture new_cap;
-    new_cap.open(path);
-    if (!new_cap.isOpened()) {
+    if (!video.open(path, luma_decode)) {
         status_error("File \"" + path + "\" failed to load");
         return;
     }
     status_info("File \"" + path + "\" loaded");
-    cap.release();
-    cap = new_cap;
-    last_file = path;
+    stop_live();
+    frame_size = video.frame_size();
     init_edit_state();
 }
 
+void window::open_live_source()
+{
+    if (live) {
+        stop_live();
+        status_info("Live source stopped");
+        return;
+    }
+    bool ok = false;
+    QString source = QInputDialog::getText(this, "Open live source", "Camera index, stream URL or video file (replayed in real time)",
+        QLineEdit::Normal, "0", &ok);
+    if (!ok || source.trimmed().isEmpty())
+        return;
+
+    // Detections are posted back to the GUI thread, anything from an older session is ignored
+    const int session = ++live_session;
+    auto on_detection = [this, session](const LiveDetection& detection) {
+        QMetaObject::invokeMethod(this, [this, session, detection]() {
+            if (!live || session != live_session)
+                return;
+            store_corners(detection.frame, detection.corners);
+            live_coverage_dirty = true;
+            }, Qt::QueuedConnection);
+    };
+    auto new_live = std::make_unique<LiveCapture>();
+    const int max_jobs = std::max(1, static_cast<int>(TaskScheduler::global().num_threads()) - 1);
+    const cv::Size board_size(ui->board_width_edit->value(), ui->board_height_edit->value());
+    if (!new_live->start(source.trimmed().toStdString(), board_size, luma_decode, max_jobs, on_detection)) {
+        status_error("Live source \"" + source.toStdString() + "\" failed to open");
+        return;
+    }
+    video.release();
+    read_success = false;
+    live = std::move(new_live);
+    live_pos = 0;
+    frame_size = live->frame_size();
+    init_edit_state();
+    ui->actionOpen_live->setText("Stop live source");
+    live_coverage_time = std::chrono::steady_clock::now();
+    live_timer.start(33);
+    status_info("Live source \"" + source.toStdString() + "\" opened");
+}
+
+void window::stop_live()
+{
+    if (!live)
+        return;
+    live_timer.stop();
+    live->stop();
+    live.reset();
+    ++live_session;
+    ui->actionOpen_live->setText("Open live source...");
+    update_total_coverage();
+}
+
+void window::on_live_tick()
+{
+    if (!live)
+        return;
+    int index = 0;
+    auto frame = live->latest_frame(index);
+    if (frame && index != live_pos) {
+        current_frame = frame;
+        current_bgr_valid = false;
+        read_success = true;
+        live_pos = index;
+        display_current_frame();
+    }
+
+    // Full coverage unions get expensive with many detections, so they are throttled
+    auto now = std::chrono::steady_clock::now();
+    if (live_coverage_dirty && now - live_coverage_time > 500ms) {
+        update_total_coverage();
+        live_coverage_dirty = false;
+        live_coverage_time = now;
+    }
+
+    auto stats = live->stats();
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Live: " << stats.capture_fps << " fps, "
+        << stats.detections << " detections, detect latency " << stats.latency_mean_ms << " ms avg / "
+        << stats.latency_p95_ms << " ms p95 / " << stats.latency_max_ms << " ms max, "
+        << stats.dropped << " of " << stats.captured << " frames dropped, "
+        << stats.frame_buffers << " frame buffers";
+    if (stats.read_failures > 0)
+        ss << ", " << stats.read_failures << " failed reads, " << stats.reconnects << " reconnects";
+    if (!live->running()) {
+        const std::string reason = live->error();
+        stop_live();
+        if (!reason.empty()) {
+            ss << " (" << reason << ")";
+            status_warn(ss.str());
+            return;
+        }
+        ss << " (source ended)";
+    }
+    status_info(ss.str());
+}
+
+void window::update_live_board_size()
+{
+    if (live)
+        live->set_board_size(cv::Size(ui->board_width_edit->value(), ui->board_height_edit->value()));
+}
+
 void window::clear_edit_focus()
 {
     ui->board_width_edit->clearFocus();
@@ -129,7 +263,7 @@ void window::play_toggle()
         playing = true;
         ui->play_button->setText("Stop");
         while (playing) {
-            if (!cap.isOpened() || !set_pos(this->current_pos() + 1))
+            if (!video.is_open() || !set_pos(this->current_pos() + 1))
                 break;
             display_current_frame();
             std::stringstream ss;
@@ -188,7 +322,10 @@ void window::show_board_display()
 
 void window::auto_detect_boards()
 {
-    if (!cap.isOpened())
+    if (!video.is_open())
+        return;
+
+    if (ui->infer_size_check->isChecked() && !detect_board_size())
         return;
 
     // Task setup
@@ -203,30 +340,298 @@ void window::auto_detect_boards()
         op_frames = 1;
     int board_width = ui->board_width_edit->value();
     int board_height = ui->board_height_edit->value();
+    bool prefilter = ui->presence_check->isChecked();
+
+    if (ui->segments_num->value() > 1 && !live) {
+        set_pos(current_pos);
+        auto_detect_segments(cv::Size(board_width, board_height), frame_step, op_frames);
+        return;
+    }
 
     // Task loop
     QProgressDialog progress("Detecting boards...", "Cancel", 0, op_frames, this);
     progress.setWindowTitle("Auto detect");
     progress.setWindowModality(Qt::WindowModal);
-    for (int i = 0; i < op_frames; ++i) {
+    ConvergenceMonitor monitor(convergence_goals(), frame_size);
+    int visited = 0, analysed = 0, boards = 0, rejected = 0;
+    bool converged = false;
+    for (int i = 0; i < op_frames && !converged; ++i) {
         progress.setValue(i);
         if (progress.wasCanceled())
             break;
-        if (i > 0) {
-            for (int j = 0; j < frame_step; ++j) {
-                success = set_pos(this->current_pos() + 1);
-            }
+        // Checking solves finish in the background, between detections
+        if (monitor.collect()) {
+            converged = monitor.converged();
+            if (converged)
+                break;
         }
+        ++visited;
+        if (i > 0)
+            success = step_frames(frame_step);
         if (!success)
             continue;
-        auto corners = get_corners(current_frame, board_width, board_height);
-        if (corners.valid)
-            frame_corners[this->current_pos()] = corners;
+        ++analysed;
+        if (prefilter && !board_plausible(current_frame->detection_image(), cv::Size(board_width, board_height))) {
+            ++rejected;
+            continue;
+        }
+        auto corners = get_corners(current_frame->detection_image(), board_width, board_height);
+        if (corners.valid) {
+            ++boards;
+            store_corners(this->current_pos(), corners);
+            converged = check_convergence(monitor);
+        }
     }
     progress.setValue(op_frames);
     set_pos(current_pos);
     update_total_coverage();
     display_current_frame();
+    std::stringstream ss;
+    ss << "Found " << boards << " boards in " << analysed << " frames";
+    if (prefilter)
+        ss << ", " << rejected << " skipped by the presence check";
+    if (converged)
+        ss << ". " << convergence_summary(monitor, 1.0 - static_cast<double>(visited) / op_frames);
+    status_info(ss.str());
+}
+
+ConvergenceGoals window::convergence_goals() const
+{
+    ConvergenceGoals goals;
+    if (!ui->converge_check->isChecked())
+        return goals;
+    goals.coverage = ui->converge_coverage_num->value() / 100;
+    goals.focal_change = ui->converge_focal_num->value() / 100;
+    goals.k1_change = ui->converge_k1_num->value();
+    goals.solve_interval = ui->converge_interval_num->value();
+    return goals;
+}
+
+bool window::check_convergence(ConvergenceMonitor& monitor)
+{
+    monitor.add_detection(coverage.covered_fraction());
+    monitor.collect();
+    if (monitor.solve_due())
+        monitor.start_solve(get_stored_corners());
+    return monitor.converged();
+}
+
+std::string window::convergence_summary(const ConvergenceMonitor& monitor, const double skipped) const
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << "Converged at " << monitor.coverage() * 100 << "% coverage";
+    if (monitor.solves() >= 2)
+        ss << std::setprecision(2) << ", fx change " << monitor.focal_change() * 100 << "%, K1 change " << std::setprecision(4) << monitor.k1_change();
+    ss << std::setprecision(0) << ", skipped " << std::max(0.0, skipped) * 100 << "% of the clip";
+    return ss.str();
+}
+
+void window::auto_detect_segments(const cv::Size board_size, const int frame_step, const int op_frames)
+{
+    SegmentScan scan;
+    scan.video_path = video.path();
+    scan.luma_decode = luma_decode;
+    scan.first_frame = 1;
+    scan.last_frame = 1 + (op_frames - 1) * frame_step;
+    scan.frame_step = frame_step;
+    scan.board_size = board_size;
+    scan.segments = ui->segments_num->value();
+    scan.prefilter = ui->presence_check->isChecked();
+
+    // Segments finish out of order, so detections queue here until the GUI thread stores them
+    std::mutex found_mutex;
+    std::vector<std::pair<int, ChessboardCorners>> found;
+    ConvergenceMonitor monitor(convergence_goals(), frame_size);
+    bool converged = false;
+    auto store_found = [&]() {
+        std::vector<std::pair<int, ChessboardCorners>> batch;
+        {
+            std::lock_guard<std::mutex> lock(found_mutex);
+            batch.swap(found);
+        }
+        for (auto& f : batch) {
+            store_corners(f.first, f.second);
+            if (!converged)
+                converged = check_convergence(monitor);
+        }
+    };
+
+    QProgressDialog progress("Detecting boards...", "Cancel", 0, op_frames, this);
+    progress.setWindowTitle("Auto detect");
+    progress.setWindowModality(Qt::WindowModal);
+    std::atomic<bool> canceled{ false };
+    std::atomic<int> done{ 0 };
+    auto future = QtConcurrent::run([&]() {
+        return run_segment_scan(scan, [&](const int pos, const ChessboardCorners& corners) {
+            std::lock_guard<std::mutex> lock(found_mutex);
+            found.emplace_back(pos, corners);
+        }, [&](const int analysed, const int total) {
+            done = analysed;
+            return !canceled.load();
+        });
+    });
+    while (!future.isFinished()) {
+        progress.setValue(done);
+        if (progress.wasCanceled())
+            canceled = true;
+        store_found();
+        // Checking solves finish in the background, so the loop keeps polling between detections
+        if (!converged && monitor.collect())
+            converged = monitor.converged();
+        if (converged)
+            canceled = true;
+        qApp->processEvents(QEventLoop::AllEvents, 50);
+        std::this_thread::sleep_for(10ms);
+    }
+    progress.setValue(op_frames);
+    store_found();
+    update_total_coverage();
+    display_current_frame();
+
+    auto stats = future.result();
+    std::stringstream ss;
+    ss << "Found " << stats.boards << " boards in " << stats.analysed << " frames over " << stats.segments << " segments";
+    ss << " in " << std::fixed << std::setprecision(1) << stats.seconds << "s";
+    if (stats.keyframes == 0)
+        ss << " (no keyframe index, even split)";
+    if (scan.prefilter)
+        ss << ", " << stats.rejected << " skipped by the presence check";
+    // Convergence stops the scan through the cancel flag, which is not an error here
+    if (converged)
+        status_info(ss.str() + ". " + convergence_summary(monitor, 1.0 - static_cast<double>(stats.visited) / op_frames));
+    else if (stats.success)
+        status_info(ss.str());
+    else
+        status_warn(ss.str() + ". " + stats.error);
+}
+
+void window::distributed_detect_boards()
+{
+    if (!video.is_open() || live)
+        return;
+
+    bool ok = false;
+    auto list = QInputDialog::getText(this, "Auto detect on workers", "Workers (host:port, comma separated):",
+        QLineEdit::Normal, QString::fromStdString(worker_list), &ok);
+    if (!ok)
+        return;
+    auto workers = parse_worker_addresses(list.toStdString());
+    if (workers.empty()) {
+        status_error("Auto detect on workers failed: No valid worker address given");
+        return;
+    }
+    worker_list = list.toStdString();
+    const QStringList modes = { "Workers read the video file", "Send decoded frames to workers" };
+    auto mode = QInputDialog::getItem(this, "Auto detect on workers", "Frame source:", modes, 0, false, &ok);
+    if (!ok)
+        return;
+
+    if (ui->infer_size_check->isChecked() && !detect_board_size())
+        return;
+
+    DistributedScan scan;
+    scan.video_path = std::filesystem::absolute(video.path()).string();
+    scan.send_frames = mode == modes.at(1);
+    scan.first_frame = 1;
+    scan.last_frame = std::max(1, total_frames());
+    scan.frame_step = ui->frame_step_num->value();
+    scan.board_size = cv::Size(ui->board_width_edit->value(), ui->board_height_edit->value());
+
+    QProgressDialog progress("Detecting boards on workers...", "Cancel", 0, 1, this);
+    progress.setWindowTitle("Auto detect");
+    progress.setWindowModality(Qt::WindowModal);
+    std::atomic<bool> canceled{ false };
+    std::atomic<int> done{ 0 };
+    std::atomic<int> total{ 1 };
+    auto future = QtConcurrent::run([&]() {
+        return run_distributed_scan(workers, scan, [&](const int shards_done, const int shards) {
+            done = shards_done;
+            total = shards;
+            return !canceled.load();
+        });
+    });
+    while (!future.isFinished()) {
+        progress.setMaximum(total);
+        progress.setValue(done);
+        if (progress.wasCanceled())
+            canceled = true;
+        qApp->processEvents(QEventLoop::AllEvents, 50);
+        std::this_thread::sleep_for(10ms);
+    }
+    progress.setValue(progress.maximum());
+
+    // Partial results are kept, so a rerun only needs to fill the gaps
+    auto scan_result = future.result();
+    for (auto& c : scan_result.corners)
+        store_corners(c.first, c.second);
+    update_total_coverage();
+    display_current_frame();
+    std::stringstream ss;
+    ss << "Workers found " << scan_result.corners.size() << " boards in " << scan_result.shards << " shards";
+    if (scan_result.retried_shards > 0)
+        ss << ", " << scan_result.retried_shards << " retried";
+    if (scan_result.lost_workers > 0)
+        ss << ", " << scan_result.lost_workers << " workers lost";
+    if (scan_result.success)
+        status_info(ss.str());
+    else
+        status_warn(ss.str() + ". " + scan_result.error);
+}
+
+bool window::detect_board_size()
+{
+    const int num_samples = 8;
+    int current_pos = this->current_pos();
+    int total_frames = this->total_frames();
+    std::vector<cv::Mat> samples;
+    for (int i = 0; i < num_samples; ++i) {
+        int pos = 1 + static_cast<int>(static_cast<double>(i) / num_samples * total_frames);
+        if (set_pos(pos))
+            samples.push_back(current_frame->luma().clone());
+    }
+    set_pos(current_pos);
+    if (samples.empty()) {
+        status_error("Board size detection failed: Could not read sample frames");
+        return false;
+    }
+
+    QProgressDialog progress("Detecting board size...", "Cancel", 0, 1, this);
+    progress.setWindowTitle("Auto detect");
+    progress.setWindowModality(Qt::WindowModal);
+    std::atomic<bool> canceled{ false };
+    std::atomic<int> tested{ 0 };
+    std::atomic<int> total{ 1 };
+    const cv::Size current_size(ui->board_width_edit->value(), ui->board_height_edit->value());
+    auto future = QtConcurrent::run([&]() {
+        return infer_board_size(samples, cv::Size(3, 3), cv::Size(20, 20), 2, [&](const int done, const int count) {
+            tested = done;
+            total = count;
+            return !canceled.load();
+        }, current_size);
+    });
+    while (!future.isFinished()) {
+        progress.setMaximum(total);
+        progress.setValue(tested);
+        if (progress.wasCanceled())
+            canceled = true;
+        qApp->processEvents(QEventLoop::AllEvents, 50);
+        std::this_thread::sleep_for(10ms);
+    }
+    progress.setValue(progress.maximum());
+    if (canceled)
+        return false;
+
+    auto board_size = future.result();
+    if (board_size.empty()) {
+        status_warn("FAILED TO DETECT BOARD SIZE: No grid between 3x3 and 20x20 was found in the sampled frames");
+        return false;
+    }
+    ui->board_width_edit->setValue(board_size.width);
+    ui->board_height_edit->setValue(board_size.height);
+    std::stringstream ss;
+    ss << "Detected board size " << board_size.width << "x" << board_size.height;
+    status_info(ss.str());
+    return true;
 }
 
 void window::update_board_display()
@@ -287,16 +692,38 @@ const std::vector<ChessboardCorners> window::get_stored_corners() const
     return corners;
 }
 
-void window::init_edit_state()
+void window::store_corners(int pos, const ChessboardCorners& corners)
+{
+    frame_corners[pos] = corners;
+    coverage.insert(pos, corners);
+    ++corners_revision;
+}
+
+void window::clear_corners()
 {
     frame_corners.clear();
+    coverage.clear();
+    ++corners_revision;
+    ++corners_epoch;
+}
+
+void window::init_edit_state()
+{
+    clear_corners();
     ui->cam_name_edit->setText(default_cam_name.c_str());
     cam_name = default_cam_name;
     result = CalibrationResult();
+    ++result_revision;
+    bootstrap = BootstrapResult();
+    display_map_size = cv::Size();
     reset_results_display();
-    frame_corners.clear();
-    if (cap.isOpened()) {
-        read_success = cap.read(current_frame);
+    if (video.is_open()) {
+        current_frame = frame_pool.acquire();
+        read_success = video.step(1, StepStrategy::read, *current_frame);
+        current_bgr_valid = false;
+        // Playback and scanning alternate between the shown frame and the one being decoded
+        if (read_success)
+            frame_pool.reserve(*current_frame, 2);
     }
     display_current_frame();
 }
@@ -311,46 +738,178 @@ void window::display_current_frame()
     auto disp_size = ui->playback_widget->size();
     int w = disp_size.width();
     int h = disp_size.height();
-    double orig_aspect = static_cast<double>(current_frame.cols) / current_frame.rows;
+    if (w < 1 || h < 1 || !current_frame || current_frame->empty())
+        return;
+    const cv::Mat& source = display_source();
+    double orig_aspect = static_cast<double>(source.cols) / source.rows;
     double target_aspect = static_cast<double>(w) / h;
     cv::Size resize_dims;
     if (orig_aspect > target_aspect) {
         resize_dims.width = w;
-        resize_dims.height = static_cast<int>(w / orig_aspect);
+        resize_dims.height = std::max(1, static_cast<int>(w / orig_aspect));
     }
     else {
         resize_dims.height = h;
-        resize_dims.width = static_cast<int>(h * orig_aspect);
+        resize_dims.width = std::max(1, static_cast<int>(h * orig_aspect));
     }
-    cv::Mat resize_img;
-    cv::Mat display_frame;
-    current_frame.copyTo(display_frame);
+
+    // Persistent letterbox buffer, wrapped by display_image without copying
+    if (display_buffer.cols != w || display_buffer.rows != h || display_buffer.type() != source.type()) {
+        display_buffer.create(h, w, source.type());
+        display_image = QImage(display_buffer.data, display_buffer.cols, display_buffer.rows, display_buffer.step, QImage::Format_BGR888);
+    }
+    const int t = (h - resize_dims.height) / 2;
+    const int l = (w - resize_dims.width) / 2;
+    const cv::Rect frame_rect(l, t, resize_dims.width, resize_dims.height);
+    const cv::Rect borders[] = {
+        cv::Rect(0, 0, w, t),
+        cv::Rect(0, frame_rect.br().y, w, h - frame_rect.br().y),
+        cv::Rect(0, t, l, resize_dims.height),
+        cv::Rect(frame_rect.br().x, t, w - frame_rect.br().x, resize_dims.height)
+    };
+    for (auto& border : borders) {
+        if (!border.empty())
+            display_buffer(border).setTo(cv::Scalar::all(0));
+    }
+
+    // Frame is scaled down first so undistortion only runs at display resolution
+    cv::Mat display_frame = display_buffer(frame_rect);
+    if (result.success) {
+        if (display_map_size != resize_dims) {
+            result.undistort_maps(resize_dims, display_map_a, display_map_b);
+            display_map_size = resize_dims;
+        }
+        cv::resize(source, display_scratch, resize_dims, 0.0, 0.0, cv::INTER_NEAREST);
+        cv::remap(display_scratch, display_frame, display_map_a, display_map_b, cv::INTER_LINEAR);
+    }
+    else
+        cv::resize(source, display_frame, resize_dims, 0.0, 0.0, cv::INTER_NEAREST);
+    display_frame_rect = frame_rect;
+    if (show_gaps)
+        draw_coverage_gaps(display_frame);
+
     int current_pos = this->current_pos();
-    result.undistort(display_frame);
-    ChessboardCorners display_corners;
-    if (frame_corners.find(current_pos) != frame_corners.end()) {
+    auto found = frame_corners.find(current_pos);
+    if (found != frame_corners.end()) {
+        ChessboardCorners display_corners;
         if (result.success)
-            display_corners = frame_corners[current_pos].get_undistorted(result.cam_Kk);
+            display_corners = found->second.get_undistorted(result.cam_Kk);
         else
-            display_corners = frame_corners[current_pos];
-    }
-    for (auto& pt : display_corners.img_corners) {
-        pt.x /= display_corners.src_img_size.width;
-        pt.y /= display_corners.src_img_size.height;
-        pt.x *= resize_dims.width;
-        pt.y *= resize_dims.height;
-    }
-    display_corners.src_img_size = resize_dims;
-    cv::resize(display_frame, resize_img, resize_dims, 0.0, 0.0, cv::INTER_NEAREST);
-    display_corners.draw(resize_img);
-    cv::Mat letterbox_img(cv::Size(w, h), current_frame.type(), cv::Scalar(0, 0, 0));
-    const int t = (h - resize_dims.height) / 2;
-    int l = (w - resize_dims.width) / 2;
-    resize_img.copyTo(letterbox_img(cv::Rect(l, t, resize_dims.width, resize_dims.height)));
-    draw_playback_bar(letterbox_img);
-    QImage img = QImage((uchar*)letterbox_img.data, letterbox_img.cols, letterbox_img.rows, letterbox_img.step, QImage::Format_BGR888);
-    QPixmap pixmap = QPixmap::fromImage(img);
-    ui->playback_display->setPixmap(pixmap);
+            display_corners = found->second;
+        for (auto& pt : display_corners.img_corners) {
+            pt.x /= display_corners.src_img_size.width;
+            pt.y /= display_corners.src_img_size.height;
+            pt.x *= resize_dims.width;
+            pt.y *= resize_dims.height;
+        }
+        display_corners.src_img_size = resize_dims;
+        display_corners.draw(display_frame);
+    }
+    draw_playback_bar(display_buffer);
+    display_pixmap.convertFromImage(display_image);
+    ui->playback_display->setPixmap(display_pixmap);
+}
+
+const cv::Mat& window::display_source()
+{
+    // Native frames are only converted to BGR once they are actually shown
+    if (current_frame->layout == FrameLayout::bgr)
+        return current_frame->raw;
+    if (!current_bgr_valid) {
+        current_frame->to_bgr(current_bgr);
+        current_bgr_valid = true;
+    }
+    return current_bgr;
+}
+
+void window::toggle_luma_decode(bool enabled)
+{
+    luma_decode = enabled;
+    if (!video.is_open())
+        return;
+    if (!video.set_luma_decode(luma_decode) && luma_decode)
+        status_warn("Video backend does not support native format decoding, frames are converted from BGR");
+    else
+        status_info(luma_decode ? "Luma-only decode enabled" : "Luma-only decode disabled");
+    // Reload the current frame so it reflects the new mode
+    int pos = current_pos();
+    if (pos > 0 && set_pos(pos))
+        display_current_frame();
+}
+
+void window::toggle_coverage_gaps(bool enabled)
+{
+    show_gaps = enabled;
+    ui->playback_display->setMouseTracking(enabled);
+    display_current_frame();
+}
+
+// The grid is drawn through the same maps as the frame, so gaps line up with the undistorted view
+void window::draw_coverage_gaps(cv::Mat& img)
+{
+    cv::Mat mask = coverage.gap_mask();
+    if (mask.empty())
+        return;
+    cv::resize(mask, gap_display, img.size(), 0.0, 0.0, cv::INTER_NEAREST);
+    if (result.success && display_map_size == img.size()) {
+        cv::remap(gap_display, mask, display_map_a, display_map_b, cv::INTER_NEAREST);
+        gap_display = mask;
+    }
+    img.convertTo(gap_tint, -1, 0.6);
+    gap_tint += cv::Scalar(0, 0, 102);
+    gap_tint.copyTo(img, gap_display);
+}
+
+bool window::display_to_source(const QPoint& pos, cv::Point2f& out)
+{
+    auto label_size = ui->playback_display->size();
+    if (display_buffer.empty() || display_frame_rect.empty() || frame_size.empty() || label_size.isEmpty())
+        return false;
+    const double x = static_cast<double>(pos.x()) * display_buffer.cols / label_size.width() - display_frame_rect.x;
+    const double y = static_cast<double>(pos.y()) * display_buffer.rows / label_size.height() - display_frame_rect.y;
+    if (x < 0 || y < 0 || x >= display_frame_rect.width || y >= display_frame_rect.height)
+        return false;
+    out = cv::Point2f(static_cast<float>(x * frame_size.width / display_frame_rect.width),
+        static_cast<float>(y * frame_size.height / display_frame_rect.height));
+    out = result.distort_pixel(out, frame_size);
+    return true;
+}
+
+void window::jump_to_covering(const QPoint& pos)
+{
+    cv::Point2f p;
+    if (live || !display_to_source(pos, p))
+        return;
+    const int frame = coverage.nearest_frame_at(p, current_pos());
+    if (frame < 1) {
+        status_warn("No detection covers this point");
+        return;
+    }
+    if (!set_pos(frame))
+        return;
+    display_current_frame();
+    std::stringstream ss;
+    ss << "Jumped to frame " << frame << ", " << coverage.frames_at(p).size() << " detections cover this point";
+    status_info(ss.str());
+}
+
+bool window::eventFilter(QObject* watched, QEvent* event)
+{
+    if (watched == ui->playback_display && read_success) {
+        if (event->type() == QEvent::MouseButtonDblClick) {
+            jump_to_covering(static_cast<QMouseEvent*>(event)->position().toPoint());
+            return true;
+        }
+        if (event->type() == QEvent::MouseMove && show_gaps) {
+            cv::Point2f p;
+            if (display_to_source(static_cast<QMouseEvent*>(event)->position().toPoint(), p)) {
+                std::stringstream ss;
+                ss << coverage.frames_at(p).size() << " detections cover (" << static_cast<int>(p.x) << ", " << static_cast<int>(p.y) << ")";
+                status_info(ss.str());
+            }
+        }
+    }
+    return QMainWindow::eventFilter(watched, event);
 }
 
 void window::playback_display_mode()
@@ -375,47 +934,41 @@ void window::playback_tooltip_mode()
 
 int window::current_pos()
 {
-    if (!cap.isOpened())
-        return 0;
-    return static_cast<int>(cap.get(cv::CAP_PROP_POS_FRAMES));
+    if (live)
+        return live_pos;
+    return video.current_pos();
 }
 
 int window::total_frames()
 {
-    if (!cap.isOpened())
-        return 0;
-    return static_cast<int>(cap.get(cv::CAP_PROP_FRAME_COUNT));
+    if (live)
+        return live_pos;
+    return video.total_frames();
 }
 
 bool window::set_pos(int pos)
 {
-    if (!cap.isOpened())
-        return false;
-    int current_pos = this->current_pos();
-    int total_frames = this->total_frames();
-    if (pos < 1 || pos > total_frames)
-        return false;
-    if (pos - current_pos != 1 && !cap.set(cv::CAP_PROP_POS_FRAMES, pos - 1))
-        return false;
-    cv::Mat next_frame;
-    bool next_success = cap.read(next_frame);
-    for (int i = 0; i < 100; ++i) {
-        if (!next_success)
-            next_success = cap.read(next_frame);
-        else
-            break;
-    }
-    if (!next_success) {
-        status_error("Read failure on frame " + std::to_string(static_cast<int>(cap.get(cv::CAP_PROP_POS_FRAMES)) + 1));
-        cap.release();
-        cv::VideoCapture new_cap;
-        new_cap.open(last_file);
-        cap = new_cap;
-        cap.set(cv::CAP_PROP_POS_FRAMES, current_pos);
+    auto next_frame = frame_pool.acquire();
+    return accept_frame(video.set_pos(pos, *next_frame), std::move(next_frame));
+}
+
+// Auto detect never looks at the frames in between, so they are only decoded
+bool window::step_frames(int count)
+{
+    auto next_frame = frame_pool.acquire();
+    return accept_frame(video.step(count, StepStrategy::grab, *next_frame), std::move(next_frame));
+}
+
+bool window::accept_frame(bool success, FrameRef frame)
+{
+    if (!success) {
+        if (video.failed_frame() > 0)
+            status_error("Read failure on frame " + std::to_string(video.failed_frame()));
         return false;
     }
-    read_success = next_success;
-    next_frame.copyTo(current_frame);
+    read_success = true;
+    current_frame = std::move(frame);
+    current_bgr_valid = false;
     return true;
 }
 
@@ -440,14 +993,14 @@ void window::prev_frame()
 }
 
 void window::detect_board() {
-    if (!(cap.isOpened() && read_success))
+    if (!(video.is_open() && read_success))
         return;
-    auto corners = get_corners(current_frame, ui->board_width_edit->value(), ui->board_height_edit->value());
+    auto corners = get_corners(current_frame->detection_image(), ui->board_width_edit->value(), ui->board_height_edit->value());
     if (!corners.valid) {
         status_warn("FAILED TO DETECT BOARD: Check width and height settings or try a different frame");
         return;
     }
-    frame_corners[current_pos()] = corners;
+    store_corners(current_pos(), corners);
     update_total_coverage();
     display_current_frame();
 }
@@ -462,30 +1015,52 @@ void window::draw_playback_bar(cv::Mat& img,
     cv::Scalar bar_color,
     cv::Scalar pos_color,
     cv::Scalar board_color) {
-    if (!cap.isOpened())
+    if (!video.is_open() && !live)
         return;
+    int total_frames = this->total_frames();
+    if (total_frames < 1)
+        return;
+
+    // Only the strip under the bar is touched, including line caps above the tallest marker
     int iw = img.cols;
     int ih = img.rows;
-    cv::Mat overlay;
-    img.copyTo(overlay);
-    cv::rectangle(overlay, cv::Point(0, ih - 1 - bar_height), cv::Point(iw - 1, ih - 1), bar_color, -1);
-    int current_pos = this->current_pos();
-    int total_frames = this->total_frames();
-    double norm_pos = static_cast<double>(current_pos) / total_frames;
-    int draw_pos = iw * norm_pos;
-    cv::line(overlay, cv::Point(draw_pos, ih - 1 - pos_height), cv::Point(draw_pos, ih - 1), pos_color, pos_width);
-    for (auto& fc : frame_corners) {
-        norm_pos = static_cast<double>(fc.first) / total_frames;
-        draw_pos = iw * norm_pos;
-        cv::line(overlay, cv::Point(draw_pos, ih - 1 - board_pos_height), cv::Point(draw_pos, ih - 1), board_color, board_pos_width);
+    int strip_top = ih - 1 - std::max({ bar_height, pos_height, board_pos_height }) - std::max(pos_width, board_pos_width);
+    strip_top = std::max(strip_top, 0);
+    cv::Mat strip = img(cv::Rect(0, strip_top, iw, ih - strip_top));
+    int sh = strip.rows;
+
+    // Board markers only change with frame_corners, so they are rendered once into a masked layer
+    if (bar_layer_revision != corners_revision || bar_layer_frames != total_frames
+        || bar_layer.size() != strip.size() || bar_layer.type() != img.type()) {
+        bar_layer.create(strip.size(), img.type());
+        bar_layer.setTo(cv::Scalar::all(0));
+        bar_mask.create(strip.size(), CV_8UC1);
+        bar_mask.setTo(cv::Scalar::all(0));
+        for (auto& fc : frame_corners) {
+            double norm_pos = static_cast<double>(fc.first) / total_frames;
+            int draw_pos = static_cast<int>(iw * norm_pos);
+            cv::Point top(draw_pos, sh - 1 - board_pos_height);
+            cv::Point bottom(draw_pos, sh - 1);
+            cv::line(bar_layer, top, bottom, board_color, board_pos_width);
+            cv::line(bar_mask, top, bottom, cv::Scalar(255), board_pos_width);
+        }
+        bar_layer_revision = corners_revision;
+        bar_layer_frames = total_frames;
     }
-    cv::addWeighted(overlay, bar_transparency, img, 1.0 - bar_transparency, 0, img);
+
+    strip.copyTo(bar_overlay);
+    cv::rectangle(bar_overlay, cv::Point(0, sh - 1 - bar_height), cv::Point(iw - 1, sh - 1), bar_color, -1);
+    double norm_pos = static_cast<double>(this->current_pos()) / total_frames;
+    int draw_pos = static_cast<int>(iw * norm_pos);
+    cv::line(bar_overlay, cv::Point(draw_pos, sh - 1 - pos_height), cv::Point(draw_pos, sh - 1), pos_color, pos_width);
+    bar_layer.copyTo(bar_overlay, bar_mask);
+    cv::addWeighted(bar_overlay, bar_transparency, strip, 1.0 - bar_transparency, 0, strip);
 }
 
 void window::update_total_coverage()
 {
     auto stored_corners = get_stored_corners();
-    if (stored_corners.empty() || !cap.isOpened()) {
+    if (stored_corners.empty() || frame_size.empty()) {
         std::string reset_str;
         for (int i = 0; i < result_max_chars; ++i) {
             reset_str += '-';
@@ -494,23 +1069,53 @@ void window::update_total_coverage()
         return;
     }
     double area = get_combined_area(stored_corners);
-    int w = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_WIDTH));
-    int h = static_cast<int>(cap.get(cv::CAP_PROP_FRAME_HEIGHT));
-    int wh = w * h;
+    int wh = frame_size.area();
     ui->tot_cov_num->setText(QString::number(area / wh * 100, 'f'));
 }
 
 void window::update_focal_length()
 {
-    if (!result.success || !cap.isOpened()) {
+    if (!result.success || frame_size.empty()) {
         std::string reset_str;
         for (int i = 0; i < result_max_chars; ++i) {
             reset_str += '-';
         }
         ui->focal_length_num->setText(reset_str.c_str());
+        display_uncertainty();
         return;
     }
     ui->focal_length_num->setText(QString::number(result.focal_length(ui->sensor_width_edit->value()), 'f'));
+    display_uncertainty();
+}
+
+void window::display_uncertainty()
+{
+    QLabel* labels[] = {
+        ui->avg_err_sd, ui->sol_cov_sd, ui->focal_length_sd, ui->hfov_sd,
+        ui->norm_fx_sd, ui->dist_k1_sd, ui->dist_k2_sd, ui->dist_k3_sd
+    };
+    for (auto label : labels) {
+        label->clear();
+        label->setToolTip(QString());
+    }
+    if (!bootstrap.success || !result.success)
+        return;
+    auto show = [this](QLabel* label, const ParameterInterval& p) {
+        label->setText(QString(QChar(0x00B1)) + " " + QString::number(p.std_dev, 'g', 3));
+        label->setToolTip(QString("%1% confidence interval: [%2, %3] from %4 resampled solves")
+            .arg(bootstrap.confidence * 100, 0, 'f', 0)
+            .arg(p.lower, 0, 'f')
+            .arg(p.upper, 0, 'f')
+            .arg(bootstrap.replicates));
+    };
+    show(ui->avg_err_sd, bootstrap.avg_err);
+    show(ui->sol_cov_sd, bootstrap.sol_cov);
+    show(ui->focal_length_sd, bootstrap.norm_fx.scaled(ui->sensor_width_edit->value()));
+    show(ui->hfov_sd, bootstrap.h_fov);
+    show(ui->norm_fx_sd, bootstrap.norm_fx);
+    show(ui->dist_k1_sd, bootstrap.k1);
+    show(ui->dist_k2_sd, bootstrap.k2);
+    show(ui->dist_k3_sd, bootstrap.k3);
 }
 
 void window::to_next_board()
@@ -558,11 +1163,150 @@ void window::to_end()
     status_info("Jumped to end");
 }
 
+CalibrationSolver window::selected_solver() const
+{
+    return ui->solver_combo->currentIndex() == 1 ? CalibrationSolver::bundle : CalibrationSolver::opencv;
+}
+
 void window::update_solution()
 {
-    result = calibrate_camera(get_stored_corners());
+    if (solve_cancel) {
+        cancel_solve();
+        status_warn("Solution update canceled");
+        return;
+    }
+
+    // Solve runs in the background, progress is posted back to the GUI thread from the selection rounds
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    solve_cancel = cancel;
+    solve_revision = corners_revision;
+    solve_epoch = corners_epoch;
+    SolveProgress progress = [this, cancel](const int round, const int total) {
+        if (cancel->load())
+            return false;
+        QMetaObject::invokeMethod(this, [this, cancel, round, total]() {
+            if (cancel->load())
+                return;
+            std::stringstream ss;
+            if (round < total)
+                ss << "Solving... selecting views (" << round << " of " << total << ")";
+            else
+                ss << "Solving... fitting camera model";
+            status_info(ss.str());
+            }, Qt::QueuedConnection);
+        return true;
+    };
+    // The bundle solver starts from the previous solution when there is one
+    solve_watcher.setFuture(QtConcurrent::run([corners = get_stored_corners(), progress, solver = selected_solver(), previous = result]() {
+        return calibrate_camera(corners, 10, progress, solver, &previous);
+    }));
+    ui->update_solution_button->setText("Cancel update");
+    status_info("Solving...");
+}
+
+void window::cancel_solve()
+{
+    if (!solve_cancel)
+        return;
+    solve_cancel->store(true);
+    solve_cancel.reset();
+    ui->update_solution_button->setText("Update solution");
+}
+
+void window::on_solve_finished()
+{
+    // Canceled jobs finish on their own time and are simply dropped
+    if (!solve_cancel)
+        return;
+    solve_cancel.reset();
+    ui->update_solution_button->setText("Update solution");
+    // Live sources keep adding detections, so there only a new source makes a result stale
+    if (solve_epoch != corners_epoch || (!live && solve_revision != corners_revision)) {
+        status_warn("Detections changed during solve, result discarded. Update the solution again");
+        return;
+    }
+    result = solve_watcher.result();
+    ++result_revision;
+    bootstrap = BootstrapResult();
+    display_map_size = cv::Size();
     display_results();
     display_current_frame();
+    if (result.success)
+        status_info("Solution updated");
+    else
+        status_warn("Solution failed: No usable detections");
+}
+
+void window::run_bootstrap()
+{
+    if (bootstrap_cancel) {
+        cancel_bootstrap();
+        status_warn("Uncertainty estimate canceled");
+        return;
+    }
+    if (!result.success) {
+        status_warn("Update the solution before estimating its uncertainty");
+        return;
+    }
+
+    auto cancel = std::make_shared<std::atomic<bool>>(false);
+    bootstrap_cancel = cancel;
+    bootstrap_epoch = corners_epoch;
+    bootstrap_revision = corners_revision;
+    bootstrap_result_revision = result_revision;
+    const int max_replicates = 200;
+    const double time_budget = ui->bootstrap_budget_num->value();
+    SolveProgress progress = [this, cancel](const int done, const int total) {
+        if (cancel->load())
+            return false;
+        QMetaObject::invokeMethod(this, [this, cancel, done, total]() {
+            if (cancel->load())
+                return;
+            std::stringstream ss;
+            ss << "Estimating uncertainty... " << done << " of up to " << total << " resampled solves";
+            status_info(ss.str());
+            }, Qt::QueuedConnection);
+        return true;
+    };
+    bootstrap_watcher.setFuture(QtConcurrent::run([corners = get_stored_corners(), max_replicates, time_budget, progress, solver = selected_solver()]() {
+        return bootstrap_calibration(corners, 10, max_replicates, time_budget, 0.95, progress, solver);
+    }));
+    ui->bootstrap_button->setText("Cancel estimate");
+    status_info("Estimating uncertainty...");
+}
+
+void window::cancel_bootstrap()
+{
+    if (!bootstrap_cancel)
+        return;
+    bootstrap_cancel->store(true);
+    bootstrap_cancel.reset();
+    ui->bootstrap_button->setText("Estimate uncertainty");
+}
+
+void window::on_bootstrap_finished()
+{
+    if (!bootstrap_cancel)
+        return;
+    bootstrap_cancel.reset();
+    ui->bootstrap_button->setText("Estimate uncertainty");
+    if (bootstrap_epoch != corners_epoch || (!live && bootstrap_revision != corners_revision)) {
+        status_warn("Detections changed during uncertainty estimate, result discarded");
+        return;
+    }
+    if (bootstrap_result_revision != result_revision) {
+        status_warn("Solution changed during uncertainty estimate, result discarded");
+        return;
+    }
+    bootstrap = bootstrap_watcher.result();
+    update_focal_length();
+    if (!bootstrap.success) {
+        status_warn("Uncertainty estimate failed: Not enough resampled solves finished within the time budget");
+        return;
+    }
+    std::stringstream ss;
+    ss << "Uncertainty estimated from " << bootstrap.replicates << " resampled solves";
+    status_info(ss.str());
 }
 
 void window::open_file()
@@ -573,6 +1317,182 @@ void window::open_file()
     attempt_video_load(fn.toStdString());
 }
 
+void window::export_undistorted_clip()
+{
+    if (!result.success || !video.is_open())
+        return;
+    auto path = undistorted_path(video.path(), std::filesystem::path(video.path()).parent_path().string());
+    QString fn = QFileDialog::getSaveFileName(this, "Export Undistorted Clip", QString::fromStdString(path));
+    if (fn.isEmpty() || fn.isNull())
+        return;
+    if (std::filesystem::absolute(fn.toStdString()) == std::filesystem::absolute(video.path())) {
+        status_error("Export undistorted clip failed: Output would overwrite the loaded clip");
+        return;
+    }
+    run_undistort_export({ { video.path(), fn.toStdString() } });
+}
+
+void window::export_undistorted_batch()
+{
+    if (!result.success)
+        return;
+    QStringList inputs = QFileDialog::getOpenFileNames(this, "Clips To Undistort", QString::fromStdString(std::filesystem::current_path().string()));
+    if (inputs.isEmpty())
+        return;
+    QString dir = QFileDialog::getExistingDirectory(this, "Output Directory", QFileInfo(inputs.first()).absolutePath());
+    if (dir.isEmpty() || dir.isNull())
+        return;
+    std::vector<std::string> input_paths;
+    for (auto& in : inputs)
+        input_paths.push_back(in.toStdString());
+    auto output_paths = undistorted_paths(input_paths, dir.toStdString());
+    std::vector<std::pair<std::string, std::string>> clips;
+    for (size_t i = 0; i < input_paths.size(); ++i)
+        clips.emplace_back(input_paths.at(i), output_paths.at(i));
+    run_undistort_export(clips);
+}
+
+void window::run_undistort_export(const std::vector<std::pair<std::string, std::string>>& clips)
+{
+    bool ok = false;
+    UndistortExportOptions options;
+    options.scale = QInputDialog::getDouble(this, "Export undistorted", "Output scale:", 1.0, 0.1, 4.0, 2, &ok);
+    if (!ok)
+        return;
+    const QStringList methods = { "Linear", "Cubic", "Lanczos", "Nearest" };
+    const int interpolations[] = { cv::INTER_LINEAR, cv::INTER_CUBIC, cv::INTER_LANCZOS4, cv::INTER_NEAREST };
+    auto method = QInputDialog::getItem(this, "Export undistorted", "Interpolation:", methods, 0, false, &ok);
+    if (!ok)
+        return;
+    options.interpolation = interpolations[methods.indexOf(method)];
+
+    QProgressDialog progress("Exporting undistorted frames...", "Cancel", 0, 1, this);
+    progress.setWindowTitle("Export undistorted");
+    progress.setWindowModality(Qt::WindowModal);
+    std::atomic<bool> canceled{ false };
+    std::atomic<int> done{ 0 };
+    std::atomic<int> total{ 1 };
+    // processEvents can let a finished solve replace result, so the export keeps its own copy
+    auto future = QtConcurrent::run([&, cam = result]() {
+        return export_undistorted(cam, clips, options, [&](const int frames, const int count) {
+            done = frames;
+            total = count;
+            return !canceled.load();
+        });
+    });
+    while (!future.isFinished()) {
+        progress.setMaximum(total);
+        progress.setValue(done);
+        if (progress.wasCanceled())
+            canceled = true;
+        qApp->processEvents(QEventLoop::AllEvents, 50);
+        std::this_thread::sleep_for(10ms);
+    }
+    progress.setValue(progress.maximum());
+
+    auto stats = future.result();
+    if (!stats.success) {
+        status_error("Export undistorted failed: " + stats.error);
+        return;
+    }
+    std::stringstream ss;
+    ss << "Exported " << stats.frames << " undistorted frames from " << stats.clips << " clips in " << std::fixed << std::setprecision(1)
+        << stats.seconds << " s (" << (stats.seconds > 0 ? stats.frames / stats.seconds : 0.0) << " fps)";
+    status_info(ss.str());
+}
+
+void window::export_stmaps()
+{
+    if (!result.success)
+        return;
+    bool ok = false;
+    const QString default_size = QString("%1x%2").arg(result.src_img_size.width).arg(result.src_img_size.height);
+    auto size_text = QInputDialog::getText(this, "Export ST-maps", "Plate resolution (WxH):", QLineEdit::Normal, default_size, &ok);
+    if (!ok)
+        return;
+    auto dims = size_text.toLower().split('x');
+    const cv::Size plate = dims.size() == 2 ? cv::Size(dims.at(0).trimmed().toInt(), dims.at(1).trimmed().toInt()) : cv::Size();
+    if (plate.width < 1 || plate.height < 1) {
+        status_error("Export ST-maps failed: \"" + size_text.toStdString() + "\" is not a resolution");
+        return;
+    }
+    const double overscan = QInputDialog::getDouble(this, "Export ST-maps", "Overscan:", 1.0, 1.0, 2.0, 2, &ok);
+    if (!ok)
+        return;
+    const QStringList directions = { "Undistort and redistort", "Undistort", "Redistort" };
+    auto direction = QInputDialog::getItem(this, "Export ST-maps", "Maps:", directions, 0, false, &ok);
+    if (!ok)
+        return;
+    std::string base_name = ui->cam_name_edit->text().toStdString() + "_stmap.exr";
+    auto path = std::filesystem::current_path() / base_name;
+    QString fn = QFileDialog::getSaveFileName(this, "Export ST-maps", QString::fromStdString(path.string()),
+        "OpenEXR (*.exr);;Float TIFF (*.tif);;16-bit PNG (*.png)");
+    if (fn.isEmpty() || fn.isNull())
+        return;
+
+    // Both maps share the chosen name with a suffix
+    std::vector<std::pair<STMapDirection, std::string>> jobs;
+    const std::filesystem::path out(fn.toStdString());
+    auto suffixed = [&](const std::string& suffix) {
+        return (out.parent_path() / (out.stem().string() + suffix + out.extension().string())).string();
+    };
+    if (direction == directions.at(0)) {
+        jobs.emplace_back(STMapDirection::undistort, suffixed("_undistort"));
+        jobs.emplace_back(STMapDirection::redistort, suffixed("_redistort"));
+    }
+    else
+        jobs.emplace_back(direction == directions.at(1) ? STMapDirection::undistort : STMapDirection::redistort, out.string());
+
+    QProgressDialog progress("Computing ST-maps...", "Cancel", 0, 1, this);
+    progress.setWindowTitle("Export ST-maps");
+    progress.setWindowModality(Qt::WindowModal);
+    std::atomic<bool> canceled{ false };
+    std::atomic<int> done{ 0 };
+    std::atomic<int> total{ 1 };
+    // processEvents can let a finished solve replace result, so the maps are computed from a copy
+    auto future = QtConcurrent::run([&, cam = result]() {
+        std::string error;
+        double seconds = 0.0;
+        int unconverged = 0;
+        for (size_t i = 0; i < jobs.size() && error.empty(); ++i) {
+            STMapOptions options;
+            options.direction = jobs.at(i).first;
+            options.size = plate;
+            options.overscan = overscan;
+            auto map = compute_stmap(cam, options, [&](const int tiles_done, const int tiles) {
+                total = tiles * static_cast<int>(jobs.size());
+                done = tiles_done + tiles * static_cast<int>(i);
+                return !canceled.load();
+            });
+            if (map.st.empty())
+                error = "Canceled";
+            else if (write_stmap(map, jobs.at(i).second, error)) {
+                seconds += map.seconds;
+                unconverged += map.unconverged;
+            }
+        }
+        std::stringstream ss;
+        if (error.empty())
+            ss << "Exported " << jobs.size() << " ST-maps at " << plate.width << "x" << plate.height << " in " << std::fixed
+                << std::setprecision(2) << seconds << " s" << (unconverged > 0 ? ", " + std::to_string(unconverged) + " pixels without inverse" : "");
+        return std::make_pair(error, ss.str());
+    });
+    while (!future.isFinished()) {
+        progress.setMaximum(total);
+        progress.setValue(done);
+        if (progress.wasCanceled())
+            canceled = true;
+        qApp->processEvents(QEventLoop::AllEvents, 50);
+        std::this_thread::sleep_for(10ms);
+    }
+    progress.setValue(progress.maximum());
+    auto outcome = future.result();
+    if (!outcome.first.empty())
+        status_error("Export ST-maps failed: " + outcome.first);
+    else
+        status_info(outcome.second);
+}
+
 void window::export_profile()
 {
     if (!result.success)
@@ -597,7 +1517,24 @@ void window::export_profile()
     out_stream << "norm_fx=" << result.h_ratio() << std::endl;
     out_stream << "dist_k1=" << result.cam_Kk.k(0) << std::endl;
     out_stream << "dist_k2=" << result.cam_Kk.k(1) << std::endl;
-    out_stream << "dist_k3=" << result.cam_Kk.k(3) << std::endl;
+    out_stream << "dist_k3=" << result.cam_Kk.k(2) << std::endl;
+    if (bootstrap.success) {
+        auto write_interval = [&](const std::string& name, const ParameterInterval& p) {
+            out_stream << name << "_sd=" << p.std_dev << std::endl;
+            out_stream << name << "_ci_low=" << p.lower << std::endl;
+            out_stream << name << "_ci_high=" << p.upper << std::endl;
+        };
+        out_stream << "bootstrap_replicates=" << bootstrap.replicates << std::endl;
+        out_stream << "bootstrap_confidence=" << bootstrap.confidence << std::endl;
+        write_interval("sol_cov", bootstrap.sol_cov);
+        write_interval("avg_err", bootstrap.avg_err);
+        write_interval("focal_length", bootstrap.norm_fx.scaled(ui->sensor_width_edit->value()));
+        write_interval("hfov", bootstrap.h_fov);
+        write_interval("norm_fx", bootstrap.norm_fx);
+        write_interval("dist_k1", bootstrap.k1);
+        write_interval("dist_k2", bootstrap.k2);
+        write_interval("dist_k3", bootstrap.k3);
+    }
     out_stream.close();
     status_info("Camera profile exported to \"" + fn.toStdString() + "\"");
 }
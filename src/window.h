@@ -2,8 +2,20 @@
 #define WINDOW_H
 
 #include <QMainWindow>
+#include <QImage>
+#include <QPixmap>
+#include <QFutureWatcher>
+#include <QTimer>
+#include <atomic>
+#include <memory>
 #include "calibration.hpp"
+#include "convergence.hpp"
+#include "coverage.hpp"
 #include "boarddisplay.hpp"
+#include "frame.hpp"
+#include "framepool.hpp"
+#include "livecapture.hpp"
+#include "videosource.hpp"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -24,6 +36,7 @@ protected:
     void dropEvent(QDropEvent* event) override;
     void resizeEvent(QResizeEvent* event) override;
     void closeEvent(QCloseEvent* event) override;
+    bool eventFilter(QObject* watched, QEvent* event) override;
 
 
 private:
@@ -32,14 +45,59 @@ private:
     bool playing = false;
     int result_max_chars = 8;
     CalibrationResult result;
+    // Bumped whenever result is replaced, so late work based on an older solution can tell
+    size_t result_revision = 0;
+    QFutureWatcher<CalibrationResult> solve_watcher;
+    std::shared_ptr<std::atomic<bool>> solve_cancel;
+    size_t solve_revision = 0;
+    size_t solve_epoch = 0;
+    BootstrapResult bootstrap;
+    QFutureWatcher<BootstrapResult> bootstrap_watcher;
+    std::shared_ptr<std::atomic<bool>> bootstrap_cancel;
+    size_t bootstrap_epoch = 0;
+    size_t bootstrap_revision = 0;
+    size_t bootstrap_result_revision = 0;
     std::map<int, ChessboardCorners> frame_corners;
+    size_t corners_revision = 0;
+    size_t corners_epoch = 0;
+    CoverageIndex coverage;
+    bool show_gaps = false;
     const std::string default_cam_name = "Camera";
     std::string cam_name = default_cam_name;
-    cv::VideoCapture cap;
-    cv::Mat current_frame;
+    VideoSource video;
+    cv::Size frame_size;
+    std::unique_ptr<LiveCapture> live;
+    QTimer live_timer;
+    int live_pos = 0;
+    int live_session = 0;
+    bool live_coverage_dirty = false;
+    std::chrono::steady_clock::time_point live_coverage_time;
+    // Decode and live capture fill pooled buffers, the display and detection share them by handle
+    FramePool frame_pool;
+    FrameRef current_frame;
+    cv::Mat current_bgr;
+    bool current_bgr_valid = false;
+    bool luma_decode = false;
     bool read_success = false;
     const std::string orig_playback_tooltip;
-    std::string last_file;
+    std::string worker_list = "127.0.0.1:5150";
+
+    // Display pipeline state, reused between frames
+    cv::Mat display_buffer;
+    cv::Mat display_scratch;
+    cv::Mat display_map_a;
+    cv::Mat display_map_b;
+    cv::Size display_map_size;
+    QImage display_image;
+    QPixmap display_pixmap;
+    cv::Mat bar_overlay;
+    cv::Mat bar_layer;
+    cv::Mat bar_mask;
+    size_t bar_layer_revision = 0;
+    int bar_layer_frames = -1;
+    cv::Rect display_frame_rect;
+    cv::Mat gap_display;
+    cv::Mat gap_tint;
 
     void status_info(std::string msg);
     void status_warn(std::string msg);
@@ -47,23 +105,43 @@ private:
 
     void clear_edit_focus();
     void auto_detect_boards();
+    void auto_detect_segments(const cv::Size board_size, const int frame_step, const int op_frames);
+    ConvergenceGoals convergence_goals() const;
+    bool check_convergence(ConvergenceMonitor& monitor);
+    std::string convergence_summary(const ConvergenceMonitor& monitor, const double skipped) const;
+    bool detect_board_size();
+    void distributed_detect_boards();
     void show_board_display();
     void update_board_display();
     void close_board_display();
     void attempt_video_load(std::string path);
+    void open_live_source();
+    void stop_live();
+    void on_live_tick();
+    void update_live_board_size();
     void play_toggle();
     void on_playback_select();
     void on_cam_name_change();
     void reset_results_display();
     void display_results();
     const std::vector<ChessboardCorners> get_stored_corners() const;
+    void store_corners(int pos, const ChessboardCorners& corners);
+    void clear_corners();
     void init_edit_state();
+    const cv::Mat& display_source();
     void display_current_frame();
+    void toggle_luma_decode(bool enabled);
+    void toggle_coverage_gaps(bool enabled);
+    void draw_coverage_gaps(cv::Mat& img);
+    bool display_to_source(const QPoint& pos, cv::Point2f& out);
+    void jump_to_covering(const QPoint& pos);
     void playback_display_mode();
     void playback_tooltip_mode();
     int current_pos();
     int total_frames();
     bool set_pos(int pos);
+    bool step_frames(int count);
+    bool accept_frame(bool success, FrameRef frame);
     void next_frame();
     void prev_frame();
     void detect_board();
@@ -84,9 +162,20 @@ private:
     void to_prev_board();
     void to_beginning();
     void to_end();
+    CalibrationSolver selected_solver() const;
     void update_solution();
+    void cancel_solve();
+    void on_solve_finished();
+    void run_bootstrap();
+    void cancel_bootstrap();
+    void on_bootstrap_finished();
+    void display_uncertainty();
     void open_file();
     void export_profile();
+    void export_undistorted_clip();
+    void export_undistorted_batch();
+    void run_undistort_export(const std::vector<std::pair<std::string, std::string>>& clips);
+    void export_stmaps();
 };
 
 #endif // WINDOW_H